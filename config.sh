@@ -21,9 +21,17 @@ $CROSS_PREFIX-gcc -nostartfiles -T./boot.lds -Wl,-Map=$SHELL_FOLDER/output/lowle
 $CROSS_PREFIX-objcopy -O binary -S $SHELL_FOLDER/output/lowlevelboot/lowlevel_fw.elf $SHELL_FOLDER/output/lowlevelboot/lowlevel_fw.bin
 # 使用gnu工具生成反汇编文件，方便调试分析（当然我们这个代码太简单，不是很需要）
 $CROSS_PREFIX-objdump --source --demangle --disassemble --reloc --wide $SHELL_FOLDER/output/lowlevelboot/lowlevel_fw.elf > $SHELL_FOLDER/output/lowlevelboot/lowlevel_fw.lst
+# 编译多核IPI ping-pong测试程序，同样链接到flash起始地址
+$CROSS_PREFIX-gcc -x assembler-with-cpp -c ipi_bench.s -o $SHELL_FOLDER/output/lowlevelboot/ipi_bench.o
+$CROSS_PREFIX-gcc -nostartfiles -T./boot.lds -Wl,-Map=$SHELL_FOLDER/output/lowlevelboot/ipi_bench.map -Wl,--gc-sections $SHELL_FOLDER/output/lowlevelboot/ipi_bench.o -o $SHELL_FOLDER/output/lowlevelboot/ipi_bench.elf
+$CROSS_PREFIX-objcopy -O binary -S $SHELL_FOLDER/output/lowlevelboot/ipi_bench.elf $SHELL_FOLDER/output/lowlevelboot/ipi_bench.bin
 #制作固件详细见文档
 cd $SHELL_FOLDER/output/lowlevelboot
 rm -rf fw.bin
 dd of=fw.bin bs=1k count=32k if=/dev/zero
 dd of=fw.bin bs=1k conv=notrunc seek=0 if=lowlevel_fw.bin
+#IPI测试固件，运行方式: ./run.sh ipi_fw.bin
+rm -rf ipi_fw.bin
+dd of=ipi_fw.bin bs=1k count=32k if=/dev/zero
+dd of=ipi_fw.bin bs=1k conv=notrunc seek=0 if=ipi_bench.bin
 cd $SHELL_FOLDER
\ No newline at end of file
@@ -0,0 +1,100 @@
+#define CLINT_MSWI_BASE 0x2000000      //socket0的MSWI基地址,msip[hartid]位于base+4*hartid
+#define UART0_BASE      0x10000000     //uart0发送data寄存器
+#define IPI_ROUNDS      1000           //ping-pong往返次数
+#define MIP_MSIP        0x8            //mip/mie中机器模式软件中断位
+
+	.section .text             #定义数据段名为.text
+	.globl _start              #定义全局符号_start
+	.type _start,@function     #_start为函数
+
+_start:
+	csrr	a0, mhartid        #a0 = hart id, 整个程序中保持不变
+	li		s0, CLINT_MSWI_BASE
+	li		t0, MIP_MSIP
+	csrw	mie, t0            #只打开MSIE, mstatus.MIE保持为0:
+	                           #软件中断可以把hart从wfi唤醒,但不会真正陷入,不需要trap handler
+	beqz	a0, _ping          #hart 0 发起ping
+	li		t0, 1
+	beq		a0, t0, _pong      #hart 1 负责回应
+_park:                         #其余hart在wfi中休眠
+	wfi
+	j		_park
+
+_pong:                         #hart 1: 收到IPI后立即向hart 0回送IPI
+	jal		ra, _wait_ipi
+	li		t0, 1
+	sw		t0, 0(s0)          #msip[0] = 1
+	j		_pong
+
+_ping:                         #hart 0: 计时IPI_ROUNDS次往返
+	li		s1, IPI_ROUNDS
+	csrr	s2, mcycle
+1:
+	li		t0, 1
+	sw		t0, 4(s0)          #msip[1] = 1,一次MMIO写就是一次IPI
+	jal		ra, _wait_ipi
+	addi	s1, s1, -1
+	bnez	s1, 1b
+	csrr	s3, mcycle
+
+	la		a1, _msg_total
+	jal		ra, _puts
+	sub		a1, s3, s2         #总周期数
+	mv		s4, a1
+	jal		ra, _puthex
+	la		a1, _msg_avg
+	jal		ra, _puts
+	li		t0, IPI_ROUNDS
+	divu	a1, s4, t0         #每次往返的平均周期数
+	jal		ra, _puthex
+	li		t0, UART0_BASE
+	li		t1, '\n'
+	sb		t1, 0(t0)
+	j		_park              #完成后进入休眠
+
+#等待本hart的软件中断,然后清除自己的msip位
+_wait_ipi:
+	wfi
+	csrr	t1, mip
+	andi	t1, t1, MIP_MSIP
+	beqz	t1, _wait_ipi
+	slli	t1, a0, 2
+	add		t1, s0, t1
+	sw		zero, 0(t1)        #msip[hartid] = 0
+	ret
+
+#输出a1指向的以0结尾的字符串
+_puts:
+	li		t0, UART0_BASE
+2:
+	lbu		t1, 0(a1)
+	beqz	t1, 3f
+	sb		t1, 0(t0)
+	addi	a1, a1, 1
+	j		2b
+3:
+	ret
+
+#以16位十六进制形式输出a1
+_puthex:
+	li		t0, UART0_BASE
+	li		t2, 60             #从最高的nibble开始移位
+4:
+	srl		t1, a1, t2
+	andi	t1, t1, 0xf
+	addi	t1, t1, '0'
+	li		t3, '9'
+	ble		t1, t3, 5f
+	addi	t1, t1, 'a' - '0' - 10
+5:
+	sb		t1, 0(t0)
+	addi	t2, t2, -4
+	bgez	t2, 4b
+	ret
+
+_msg_total:                    #字符串放在代码之后,同样位于flash中
+	.string "IPI ping-pong cycles total: 0x"
+_msg_avg:
+	.string ", per round trip: 0x"
+
+    .end                       #汇编文件结束符号
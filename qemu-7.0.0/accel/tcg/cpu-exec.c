@@ -824,6 +824,12 @@ static inline bool cpu_handle_interrupt(CPUState *cpu,
         qemu_mutex_unlock_iothread();
     }
 
+#ifndef CONFIG_USER_ONLY
+    if (unlikely(qatomic_read(&cpu->pc_sample_pending))) {
+        pc_sampler_record(cpu);
+    }
+#endif
+
     /* Finally, check if we need to exit to the main loop.  */
     if (unlikely(qatomic_read(&cpu->exit_request))
         || (icount_enabled()
@@ -976,6 +982,10 @@ int cpu_exec(CPUState *cpu)
                 break;
             }
 
+            if (unlikely(cpu->tier2_hot)) {
+                tb_tier2_compile(cpu, pc, cs_base, flags, cflags);
+            }
+
             tb = tb_lookup(cpu, pc, cs_base, flags, cflags);
             if (tb == NULL) {
                 mmap_lock();
@@ -19,6 +19,10 @@
 
 #include "qemu/osdep.h"
 #include "qemu/main-loop.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-machine.h"
+#include "qapi/type-helpers.h"
+#include "sysemu/tcg.h"
 #include "hw/core/tcg-cpu-ops.h"
 #include "exec/exec-all.h"
 #include "exec/memory.h"
@@ -113,6 +117,8 @@ static void tb_flush_jmp_cache(CPUState *cpu, target_ulong addr)
        overlap the flushed page.  */
     tb_jmp_cache_clear_page(cpu, addr - TARGET_PAGE_SIZE);
     tb_jmp_cache_clear_page(cpu, addr);
+    /* The return stack was filled from tb_jmp_cache */
+    cpu_tb_ras_clear(cpu);
 }
 
 /**
@@ -230,14 +236,34 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
     }
 }
 
+static inline size_t vtlb_n_entries(const CPUTLBDesc *desc)
+{
+    return (size_t)desc->vtlb_ways << desc->vtlb_set_bits;
+}
+
+/* Return the index of the first victim tlb entry of the set for @page */
+static inline size_t vtlb_set_index(const CPUTLBDesc *desc, target_ulong page)
+{
+    uint64_t h;
+
+    if (desc->vtlb_set_bits == 0) {
+        return 0;
+    }
+    /*
+     * Pages that conflict in the main tlb share their low page number
+     * bits, so hash all of the page number to spread them over the sets.
+     */
+    h = (uint64_t)(page >> TARGET_PAGE_BITS) * 0x9e3779b97f4a7c15ull;
+    return (h >> (64 - desc->vtlb_set_bits)) * desc->vtlb_ways;
+}
+
 static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
 {
     desc->n_used_entries = 0;
-    desc->large_page_addr = -1;
-    desc->large_page_mask = -1;
+    memset(desc->large_page, -1, sizeof(desc->large_page));
     desc->vindex = 0;
     memset(fast->table, -1, sizeof_tlb(fast));
-    memset(desc->vtable, -1, sizeof(desc->vtable));
+    memset(desc->vtable, -1, vtlb_n_entries(desc) * sizeof(CPUTLBEntry));
 }
 
 static void tlb_flush_one_mmuidx_locked(CPUArchState *env, int mmu_idx,
@@ -253,6 +279,15 @@ static void tlb_flush_one_mmuidx_locked(CPUArchState *env, int mmu_idx,
 static void tlb_mmu_init(CPUTLBDesc *desc, CPUTLBDescFast *fast, int64_t now)
 {
     size_t n_entries = 1 << CPU_TLB_DYN_DEFAULT_BITS;
+    size_t vtlb_size = tcg_vtlb_size ? tcg_vtlb_size : CPU_VTLB_SIZE;
+    size_t vtlb_ways = tcg_vtlb_ways ? tcg_vtlb_ways : CPU_VTLB_WAYS;
+
+    /* Both are powers of 2, checked when setting the accel properties */
+    vtlb_ways = MIN(vtlb_ways, vtlb_size);
+    desc->vtlb_ways = vtlb_ways;
+    desc->vtlb_set_bits = ctz64(vtlb_size / vtlb_ways);
+    desc->vtable = g_new(CPUTLBEntry, vtlb_size);
+    desc->viotlb = g_new(CPUIOTLBEntry, vtlb_size);
 
     tlb_window_reset(desc, now, 0);
     desc->n_used_entries = 0;
@@ -300,6 +335,8 @@ void tlb_destroy(CPUState *cpu)
 
         g_free(fast->table);
         g_free(desc->iotlb);
+        g_free(desc->vtable);
+        g_free(desc->viotlb);
     }
 }
 
@@ -339,6 +376,58 @@ void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
     *pelide = elide;
 }
 
+HumanReadableText *qmp_x_query_vtlb(Error **errp)
+{
+    g_autoptr(GString) buf = g_string_new("");
+    CPUState *cpu;
+    int mmu_idx;
+
+    if (!tcg_enabled()) {
+        error_setg(errp, "TLB information is only available with accel=tcg");
+        return NULL;
+    }
+
+    CPU_FOREACH(cpu) {
+        CPUArchState *env = cpu->env_ptr;
+        CPUTLBDesc *d = &env_tlb(env)->d[0];
+
+        g_string_append_printf(buf, "CPU#%d victim tlb: %zu entries, "
+                               "%u-way\n", cpu->cpu_index,
+                               vtlb_n_entries(d), d->vtlb_ways);
+        for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+            size_t hit, miss, fill;
+
+            d = &env_tlb(env)->d[mmu_idx];
+            hit = qatomic_read(&d->vtlb_hit_count);
+            miss = qatomic_read(&d->vtlb_miss_count);
+            fill = qatomic_read(&d->fill_count);
+            if (!hit && !miss && !fill) {
+                continue;
+            }
+            g_string_append_printf(buf, "  mmu_idx %d: victim hits %zu "
+                                   "misses %zu, tlb fills %zu\n",
+                                   mmu_idx, hit, miss, fill);
+        }
+    }
+
+    return human_readable_text_from_str(buf);
+}
+
+void tlb_large_page_counts(size_t *pflush, size_t *pmerge)
+{
+    CPUState *cpu;
+    size_t flush = 0, merge = 0;
+
+    CPU_FOREACH(cpu) {
+        CPUArchState *env = cpu->env_ptr;
+
+        flush += qatomic_read(&env_tlb(env)->c.large_flush_count);
+        merge += qatomic_read(&env_tlb(env)->c.large_merge_count);
+    }
+    *pflush = flush;
+    *pmerge = merge;
+}
+
 static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
 {
     CPUArchState *env = cpu->env_ptr;
@@ -453,6 +542,23 @@ static inline bool tlb_entry_is_empty(const CPUTLBEntry *te)
     return te->addr_read == -1 && te->addr_write == -1 && te->addr_code == -1;
 }
 
+/**
+ * tlb_entry_page - return the page mapped by a non-empty entry
+ * @te: pointer to CPUTLBEntry
+ */
+static inline target_ulong tlb_entry_page(const CPUTLBEntry *te)
+{
+    target_ulong addr = te->addr_read;
+
+    if (addr == -1) {
+        addr = tlb_addr_write(te);
+    }
+    if (addr == -1) {
+        addr = te->addr_code;
+    }
+    return addr & TARGET_PAGE_MASK;
+}
+
 /* Called with tlb_c.lock held */
 static bool tlb_flush_entry_mask_locked(CPUTLBEntry *tlb_entry,
                                         target_ulong page,
@@ -477,10 +583,15 @@ static void tlb_flush_vtlb_page_mask_locked(CPUArchState *env, int mmu_idx,
                                             target_ulong mask)
 {
     CPUTLBDesc *d = &env_tlb(env)->d[mmu_idx];
-    int k;
+    size_t k, first = 0, n = vtlb_n_entries(d);
 
     assert_cpu_is_self(env_cpu(env));
-    for (k = 0; k < CPU_VTLB_SIZE; k++) {
+    if (mask == (target_ulong)-1) {
+        /* A single page can only be in its own set */
+        first = vtlb_set_index(d, page);
+        n = d->vtlb_ways;
+    }
+    for (k = first; k < first + n; k++) {
         if (tlb_flush_entry_mask_locked(&d->vtable[k], page, mask)) {
             tlb_n_used_entries_dec(env, mmu_idx);
         }
@@ -493,24 +604,58 @@ static inline void tlb_flush_vtlb_page_locked(CPUArchState *env, int mmu_idx,
     tlb_flush_vtlb_page_mask_locked(env, mmu_idx, page, -1);
 }
 
+/*
+ * Flush every entry within the large page region @lp of @midx, and
+ * forget the region.  The other entries of @midx, and the other large
+ * page regions, are kept.
+ *
+ * Called with tlb_c.lock held.
+ */
+static void tlb_flush_large_page_locked(CPUArchState *env, int midx,
+                                        CPUTLBLargePage *lp)
+{
+    CPUTLBDesc *d = &env_tlb(env)->d[midx];
+    CPUTLBDescFast *f = &env_tlb(env)->f[midx];
+    size_t i, n = tlb_n_entries(f);
+
+    tlb_debug("flushing large page region midx %d ("
+              TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
+              midx, lp->addr, lp->mask);
+
+    for (i = 0; i < n && d->n_used_entries; i++) {
+        if (tlb_flush_entry_mask_locked(&f->table[i], lp->addr, lp->mask)) {
+            tlb_n_used_entries_dec(env, midx);
+        }
+    }
+    for (i = 0; i < vtlb_n_entries(d); i++) {
+        tlb_flush_entry_mask_locked(&d->vtable[i], lp->addr, lp->mask);
+    }
+    lp->addr = -1;
+    lp->mask = -1;
+
+    qatomic_set(&env_tlb(env)->c.large_flush_count,
+                env_tlb(env)->c.large_flush_count + 1);
+}
+
 static void tlb_flush_page_locked(CPUArchState *env, int midx,
                                   target_ulong page)
 {
-    target_ulong lp_addr = env_tlb(env)->d[midx].large_page_addr;
-    target_ulong lp_mask = env_tlb(env)->d[midx].large_page_mask;
+    CPUTLBDesc *d = &env_tlb(env)->d[midx];
+    int i;
 
     /* Check if we need to flush due to large pages.  */
-    if ((page & lp_mask) == lp_addr) {
-        tlb_debug("forcing full flush midx %d ("
-                  TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
-                  midx, lp_addr, lp_mask);
-        tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
-    } else {
-        if (tlb_flush_entry_locked(tlb_entry(env, midx, page), page)) {
-            tlb_n_used_entries_dec(env, midx);
+    for (i = 0; i < CPU_TLB_LARGE_PAGES; i++) {
+        CPUTLBLargePage *lp = &d->large_page[i];
+
+        if ((page & lp->mask) == lp->addr) {
+            tlb_flush_large_page_locked(env, midx, lp);
         }
-        tlb_flush_vtlb_page_locked(env, midx, page);
     }
+
+    if (tlb_flush_entry_locked(tlb_entry(env, midx, page), page)) {
+        tlb_n_used_entries_dec(env, midx);
+    }
+    tlb_flush_vtlb_page_locked(env, midx, page);
 }
 
 /**
@@ -733,17 +878,14 @@ static void tlb_flush_range_locked(CPUArchState *env, int midx,
         return;
     }
 
-    /*
-     * Check if we need to flush due to large pages.
-     * Because large_page_mask contains all 1's from the msb,
-     * we only need to test the end of the range.
-     */
-    if (((addr + len - 1) & d->large_page_mask) == d->large_page_addr) {
-        tlb_debug("forcing full flush midx %d ("
-                  TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
-                  midx, d->large_page_addr, d->large_page_mask);
-        tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
-        return;
+    /* Check if we need to flush due to large pages.  */
+    for (int i = 0; i < CPU_TLB_LARGE_PAGES; i++) {
+        CPUTLBLargePage *lp = &d->large_page[i];
+
+        if (lp->addr != (target_ulong)-1 &&
+            addr <= (lp->addr | ~lp->mask) && addr + len - 1 >= lp->addr) {
+            tlb_flush_large_page_locked(env, midx, lp);
+        }
     }
 
     for (target_ulong i = 0; i < len; i += TARGET_PAGE_SIZE) {
@@ -1030,7 +1172,8 @@ void tlb_reset_dirty(CPUState *cpu, ram_addr_t start1, ram_addr_t length)
                                          start1, length);
         }
 
-        for (i = 0; i < CPU_VTLB_SIZE; i++) {
+        n = vtlb_n_entries(&env_tlb(env)->d[mmu_idx]);
+        for (i = 0; i < n; i++) {
             tlb_reset_dirty_range_locked(&env_tlb(env)->d[mmu_idx].vtable[i],
                                          start1, length);
         }
@@ -1063,36 +1206,60 @@ void tlb_set_dirty(CPUState *cpu, target_ulong vaddr)
     }
 
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-        int k;
-        for (k = 0; k < CPU_VTLB_SIZE; k++) {
-            tlb_set_dirty1_locked(&env_tlb(env)->d[mmu_idx].vtable[k], vaddr);
+        CPUTLBDesc *d = &env_tlb(env)->d[mmu_idx];
+        size_t k, first = vtlb_set_index(d, vaddr);
+
+        for (k = first; k < first + d->vtlb_ways; k++) {
+            tlb_set_dirty1_locked(&d->vtable[k], vaddr);
         }
     }
     qemu_spin_unlock(&env_tlb(env)->c.lock);
 }
 
-/* Our TLB does not support large pages, so remember the area covered by
-   large pages and trigger a full TLB flush if these are invalidated.  */
+/* Our TLB does not support large pages, so remember the areas covered by
+   large pages and flush all of an area if any page of it is invalidated.  */
 static void tlb_add_large_page(CPUArchState *env, int mmu_idx,
                                target_ulong vaddr, target_ulong size)
 {
-    target_ulong lp_addr = env_tlb(env)->d[mmu_idx].large_page_addr;
-    target_ulong lp_mask = ~(size - 1);
+    CPUTLBDesc *d = &env_tlb(env)->d[mmu_idx];
+    CPUTLBLargePage *free = NULL, *best = NULL;
+    target_ulong best_mask = 0;
+    int i;
 
-    if (lp_addr == (target_ulong)-1) {
-        /* No previous large page.  */
-        lp_addr = vaddr;
-    } else {
-        /* Extend the existing region to include the new page.
-           This is a compromise between unnecessary flushes and
-           the cost of maintaining a full variable size TLB.  */
-        lp_mask &= env_tlb(env)->d[mmu_idx].large_page_mask;
-        while (((lp_addr ^ vaddr) & lp_mask) != 0) {
+    for (i = 0; i < CPU_TLB_LARGE_PAGES; i++) {
+        CPUTLBLargePage *lp = &d->large_page[i];
+        target_ulong lp_mask;
+
+        if (lp->addr == (target_ulong)-1) {
+            free = free ? free : lp;
+            continue;
+        }
+        lp_mask = lp->mask & ~(size - 1);
+        while (((lp->addr ^ vaddr) & lp_mask) != 0) {
             lp_mask <<= 1;
         }
+        if (lp_mask == lp->mask) {
+            /* Already covered.  */
+            return;
+        }
+        /* The merged region with the most 1's in its mask is the smallest */
+        if (!best || lp_mask > best_mask) {
+            best = lp;
+            best_mask = lp_mask;
+        }
+    }
+
+    if (free) {
+        free->mask = ~(size - 1);
+        free->addr = vaddr & free->mask;
+        return;
     }
-    env_tlb(env)->d[mmu_idx].large_page_addr = lp_addr & lp_mask;
-    env_tlb(env)->d[mmu_idx].large_page_mask = lp_mask;
+
+    /* Out of regions: extend the one that grows the least.  */
+    best->addr &= best_mask;
+    best->mask = best_mask;
+    qatomic_set(&env_tlb(env)->c.large_merge_count,
+                env_tlb(env)->c.large_merge_count + 1);
 }
 
 /* Add a new TLB entry. At most one entry for a given virtual address
@@ -1214,7 +1381,8 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
      * different page; otherwise just overwrite the stale data.
      */
     if (!tlb_hit_page_anyprot(te, vaddr_page) && !tlb_entry_is_empty(te)) {
-        unsigned vidx = desc->vindex++ % CPU_VTLB_SIZE;
+        size_t vidx = vtlb_set_index(desc, tlb_entry_page(te)) +
+                      desc->vindex++ % desc->vtlb_ways;
         CPUTLBEntry *tv = &desc->vtable[vidx];
 
         /* Evict the old entry into the victim tlb.  */
@@ -1310,6 +1478,8 @@ static void tlb_fill(CPUState *cpu, target_ulong addr, int size,
      * This is not a probe, so only valid return is success; failure
      * should result in exception + longjmp to the cpu loop.
      */
+    qatomic_set(&env_tlb(cpu->env_ptr)->d[mmu_idx].fill_count,
+                env_tlb(cpu->env_ptr)->d[mmu_idx].fill_count + 1);
     ok = cc->tcg_ops->tlb_fill(cpu, addr, size,
                                access_type, mmu_idx, false, retaddr);
     assert(ok);
@@ -1456,11 +1626,12 @@ static inline target_ulong tlb_read_ofs(CPUTLBEntry *entry, size_t ofs)
 static bool victim_tlb_hit(CPUArchState *env, size_t mmu_idx, size_t index,
                            size_t elt_ofs, target_ulong page)
 {
-    size_t vidx;
+    CPUTLBDesc *desc = &env_tlb(env)->d[mmu_idx];
+    size_t vidx, first = vtlb_set_index(desc, page);
 
     assert_cpu_is_self(env_cpu(env));
-    for (vidx = 0; vidx < CPU_VTLB_SIZE; ++vidx) {
-        CPUTLBEntry *vtlb = &env_tlb(env)->d[mmu_idx].vtable[vidx];
+    for (vidx = first; vidx < first + desc->vtlb_ways; ++vidx) {
+        CPUTLBEntry *vtlb = &desc->vtable[vidx];
         target_ulong cmp;
 
         /* elt_ofs might correspond to .addr_write, so use qatomic_read */
@@ -1471,21 +1642,39 @@ static bool victim_tlb_hit(CPUArchState *env, size_t mmu_idx, size_t index,
 #endif
 
         if (cmp == page) {
-            /* Found entry in victim tlb, swap tlb and iotlb.  */
-            CPUTLBEntry tmptlb, *tlb = &env_tlb(env)->f[mmu_idx].table[index];
+            /*
+             * Found entry in victim tlb: move it to the tlb, and evict
+             * the old tlb entry into its own set, as tlb_set_page does.
+             */
+            CPUTLBEntry old, *tlb = &env_tlb(env)->f[mmu_idx].table[index];
+            CPUIOTLBEntry oldio, *io = &desc->iotlb[index];
 
             qemu_spin_lock(&env_tlb(env)->c.lock);
-            copy_tlb_helper_locked(&tmptlb, tlb);
+            copy_tlb_helper_locked(&old, tlb);
+            oldio = *io;
             copy_tlb_helper_locked(tlb, vtlb);
-            copy_tlb_helper_locked(vtlb, &tmptlb);
+            *io = desc->viotlb[vidx];
+            memset(vtlb, -1, sizeof(*vtlb));
+
+            if (!tlb_entry_is_empty(&old)) {
+                size_t set = vtlb_set_index(desc, tlb_entry_page(&old));
+
+                /* Reuse the slot just vacated if it is in the same set */
+                if (set != first) {
+                    vidx = set + desc->vindex++ % desc->vtlb_ways;
+                }
+                copy_tlb_helper_locked(&desc->vtable[vidx], &old);
+                desc->viotlb[vidx] = oldio;
+            } else {
+                tlb_n_used_entries_inc(env, mmu_idx);
+            }
             qemu_spin_unlock(&env_tlb(env)->c.lock);
 
-            CPUIOTLBEntry tmpio, *io = &env_tlb(env)->d[mmu_idx].iotlb[index];
-            CPUIOTLBEntry *vio = &env_tlb(env)->d[mmu_idx].viotlb[vidx];
-            tmpio = *io; *io = *vio; *vio = tmpio;
+            qatomic_set(&desc->vtlb_hit_count, desc->vtlb_hit_count + 1);
             return true;
         }
     }
+    qatomic_set(&desc->vtlb_miss_count, desc->vtlb_miss_count + 1);
     return false;
 }
 
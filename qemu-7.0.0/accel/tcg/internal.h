@@ -17,5 +17,18 @@ TranslationBlock *tb_gen_code(CPUState *cpu, target_ulong pc,
 G_NORETURN void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr);
 void page_init(void);
 void tb_htable_init(void);
+void tb_tier2_compile(CPUState *cpu, target_ulong pc, target_ulong cs_base,
+                      uint32_t flags, uint32_t cflags);
+
+/* Executions before a TB is considered for a superblock, 0 if disabled */
+extern uint32_t tcg_tier2_threshold;
+
+/* Victim tlb geometry, 0 for the defaults */
+extern uint32_t tcg_vtlb_size;
+extern uint32_t tcg_vtlb_ways;
+
+#ifdef CONFIG_SOFTMMU
+void pc_sampler_record(CPUState *cpu);
+#endif
 
 #endif /* ACCEL_TCG_INTERNAL_H */
@@ -0,0 +1,234 @@
+/*
+ * Sampling guest PC profiler
+ *
+ * Copyright (c) 2022 tc-newman contributors
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/*
+ * x-pc-profile-start arms a timer on the virtual clock.  Every period
+ * it asks each running vCPU for a sample the same way the round-robin
+ * kick timer does, with cpu_exit(): the vCPU leaves its TB chain and
+ * records, from cpu_handle_interrupt(), the hart, the privilege mode
+ * and the PC it was about to execute, plus optionally the return
+ * addresses found on the guest frame pointer chain.  Halted vCPUs are
+ * sampled from the timer as idle.
+ *
+ * Identical samples are only counted, and symbolized when
+ * x-pc-profile-stop writes them out in the folded stack format read
+ * by flame graph tools, one "hart;mode;outer;...;leaf count" per line.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-machine.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "hw/core/tcg-cpu-ops.h"
+#include "disas/disas.h"
+#include "exec/exec-all.h"
+#include "sysemu/tcg.h"
+#include "internal.h"
+
+#define PC_SAMPLER_PERIOD_US    1000
+#define PC_SAMPLER_MAX_FRAMES   64
+
+typedef struct PCSample {
+    int cpu_index;
+    const char *mode;
+    int n;
+    /* the PC, then the return addresses, innermost first */
+    vaddr pcs[PC_SAMPLER_MAX_FRAMES + 1];
+    /* not part of the key */
+    size_t count;
+} PCSample;
+
+static struct {
+    QemuMutex lock;
+    QEMUTimer *timer;
+    int64_t period_ns;
+    int max_frames;
+    /* set of PCSample */
+    GHashTable *samples;
+} pc_sampler;
+
+static guint pc_sample_hash(gconstpointer p)
+{
+    const PCSample *s = p;
+    guint h = s->cpu_index * 31 + g_str_hash(s->mode);
+    int i;
+
+    for (i = 0; i < s->n; i++) {
+        h = h * 31 + (guint)(s->pcs[i] ^ (s->pcs[i] >> 32));
+    }
+    return h;
+}
+
+static gboolean pc_sample_equal(gconstpointer a, gconstpointer b)
+{
+    const PCSample *x = a, *y = b;
+
+    return x->cpu_index == y->cpu_index && x->mode == y->mode &&
+           x->n == y->n && !memcmp(x->pcs, y->pcs, x->n * sizeof(vaddr));
+}
+
+static void pc_sampler_add(const PCSample *s)
+{
+    PCSample *e;
+
+    qemu_mutex_lock(&pc_sampler.lock);
+    if (pc_sampler.samples) {
+        e = g_hash_table_lookup(pc_sampler.samples, s);
+        if (!e) {
+            e = g_memdup2(s, sizeof(*s));
+            g_hash_table_add(pc_sampler.samples, e);
+        }
+        e->count++;
+    }
+    qemu_mutex_unlock(&pc_sampler.lock);
+}
+
+/* Called on the vCPU thread, between two TBs */
+void pc_sampler_record(CPUState *cpu)
+{
+    CPUClass *cc = CPU_GET_CLASS(cpu);
+    CPUArchState *env = cpu->env_ptr;
+    target_ulong pc, cs_base;
+    uint32_t flags;
+    PCSample s;
+
+    qatomic_set(&cpu->pc_sample_pending, false);
+
+    memset(&s, 0, sizeof(s));
+    s.cpu_index = cpu->cpu_index;
+    s.mode = cc->tcg_ops->sample_mode ? cc->tcg_ops->sample_mode(cpu) : "";
+
+    cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
+    s.pcs[0] = pc;
+    s.n = 1;
+
+    if (pc_sampler.max_frames && cc->tcg_ops->sample_frames) {
+        s.n += cc->tcg_ops->sample_frames(cpu, &s.pcs[1],
+                                          pc_sampler.max_frames);
+    }
+
+    pc_sampler_add(&s);
+}
+
+static void pc_sampler_tick(void *opaque)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        if (cpu->stopped) {
+            continue;
+        }
+        if (qatomic_read(&cpu->halted)) {
+            PCSample s = { .cpu_index = cpu->cpu_index, .mode = "idle" };
+
+            pc_sampler_add(&s);
+            continue;
+        }
+        qatomic_set(&cpu->pc_sample_pending, true);
+        cpu_exit(cpu);
+    }
+
+    timer_mod(pc_sampler.timer,
+              qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + pc_sampler.period_ns);
+}
+
+static void pc_sampler_init(void)
+{
+    qemu_mutex_init(&pc_sampler.lock);
+    pc_sampler.timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, pc_sampler_tick, NULL);
+}
+
+void qmp_x_pc_profile_start(bool has_period, uint32_t period,
+                            bool has_frames, uint32_t frames, Error **errp)
+{
+    if (!tcg_enabled()) {
+        error_setg(errp, "PC profiling is only available with accel=tcg");
+        return;
+    }
+    if (has_period && period == 0) {
+        error_setg(errp, "period must be greater than 0");
+        return;
+    }
+    if (has_frames && frames > PC_SAMPLER_MAX_FRAMES) {
+        error_setg(errp, "frames must be at most %d", PC_SAMPLER_MAX_FRAMES);
+        return;
+    }
+
+    if (!pc_sampler.timer) {
+        pc_sampler_init();
+    }
+    if (timer_pending(pc_sampler.timer)) {
+        error_setg(errp, "PC profiling is already running");
+        return;
+    }
+
+    qemu_mutex_lock(&pc_sampler.lock);
+    pc_sampler.period_ns = (has_period ? period : PC_SAMPLER_PERIOD_US) *
+                           SCALE_US;
+    pc_sampler.max_frames = has_frames ? frames : 0;
+    pc_sampler.samples = g_hash_table_new_full(pc_sample_hash,
+                                               pc_sample_equal,
+                                               g_free, NULL);
+    qemu_mutex_unlock(&pc_sampler.lock);
+
+    timer_mod(pc_sampler.timer,
+              qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + pc_sampler.period_ns);
+}
+
+static void pc_sampler_append_frame(GString *out, vaddr pc)
+{
+    const char *sym = lookup_symbol(pc);
+
+    if (*sym) {
+        g_string_append_printf(out, ";%s", sym);
+    } else {
+        g_string_append_printf(out, ";0x%" VADDR_PRIx, pc);
+    }
+}
+
+void qmp_x_pc_profile_stop(const char *filename, Error **errp)
+{
+    g_autoptr(GError) err = NULL;
+    g_autoptr(GString) out = g_string_new(NULL);
+    GHashTable *samples;
+    GHashTableIter iter;
+    gpointer key;
+
+    if (!pc_sampler.timer || !timer_pending(pc_sampler.timer)) {
+        error_setg(errp, "PC profiling is not running");
+        return;
+    }
+    timer_del(pc_sampler.timer);
+
+    /* Samples still pending on a vCPU are dropped by pc_sampler_add() */
+    qemu_mutex_lock(&pc_sampler.lock);
+    samples = pc_sampler.samples;
+    pc_sampler.samples = NULL;
+    qemu_mutex_unlock(&pc_sampler.lock);
+
+    g_hash_table_iter_init(&iter, samples);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        const PCSample *s = key;
+        int i;
+
+        g_string_append_printf(out, "hart%d", s->cpu_index);
+        if (*s->mode) {
+            g_string_append_printf(out, ";%s", s->mode);
+        }
+        for (i = s->n - 1; i >= 0; i--) {
+            pc_sampler_append_frame(out, s->pcs[i]);
+        }
+        g_string_append_printf(out, " %zu\n", s->count);
+    }
+    g_hash_table_destroy(samples);
+
+    if (!g_file_set_contents(filename, out->str, out->len, &err)) {
+        error_setg(errp, "%s", err->message);
+    }
+}
@@ -43,6 +43,7 @@
  * CPU's index into a TCG temp, since the first callback did it already.
  */
 #include "qemu/osdep.h"
+#include "qemu/bitmap.h"
 #include "tcg/tcg.h"
 #include "tcg/tcg-op.h"
 #include "exec/exec-all.h"
@@ -73,7 +74,9 @@ enum plugin_gen_from {
 enum plugin_gen_cb {
     PLUGIN_GEN_CB_UDATA,
     PLUGIN_GEN_CB_INLINE,
+    PLUGIN_GEN_CB_COND_UDATA,
     PLUGIN_GEN_CB_MEM,
+    PLUGIN_GEN_CB_COND_MEM,
     PLUGIN_GEN_ENABLE_MEM_HELPER,
     PLUGIN_GEN_DISABLE_MEM_HELPER,
     PLUGIN_GEN_N_CBS,
@@ -126,11 +129,26 @@ static void gen_empty_udata_cb(void)
 /*
  * For now we only support addi_i64.
  * When we support more ops, we can generate one empty inline cb for each.
+ *
+ * The counter is at ptr + cpu_index * stride.  For per-vCPU scoreboards
+ * the stride is the size of an entry; for a counter shared by all vCPUs
+ * it is 0 and the optimizer removes the index computation.
  */
 static void gen_empty_inline_cb(void)
 {
     TCGv_i64 val = tcg_temp_new_i64();
     TCGv_ptr ptr = tcg_const_ptr(NULL); /* overwritten later */
+    TCGv_i32 cpu_index = tcg_temp_new_i32();
+    TCGv_ptr cpu_offset = tcg_temp_new_ptr();
+
+    tcg_gen_ld_i32(cpu_index, cpu_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    /* the second operand is replaced with the stride */
+    tcg_gen_mul_i32(cpu_index, cpu_index, cpu_index);
+    tcg_gen_ext_i32_ptr(cpu_offset, cpu_index);
+    tcg_gen_add_ptr(ptr, ptr, cpu_offset);
+    tcg_temp_free_ptr(cpu_offset);
+    tcg_temp_free_i32(cpu_index);
 
     tcg_gen_ld_i64(val, ptr, 0);
     /* pass an immediate != 0 so that it doesn't get optimized away */
@@ -140,11 +158,74 @@ static void gen_empty_inline_cb(void)
     tcg_temp_free_i64(val);
 }
 
+/*
+ * Load a per-vCPU counter as in gen_empty_inline_cb, and branch to the
+ * returned label on it; the branch condition, the immediate and the
+ * label are replaced later on.
+ */
+static TCGLabel *gen_empty_cond_branch(void)
+{
+    TCGv_i64 val = tcg_temp_new_i64();
+    TCGv_ptr ptr = tcg_const_ptr(NULL); /* overwritten later */
+    TCGv_i32 cpu_index = tcg_temp_new_i32();
+    TCGv_ptr cpu_offset = tcg_temp_new_ptr();
+    TCGLabel *skip = gen_new_label();
+
+    tcg_gen_ld_i32(cpu_index, cpu_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    tcg_gen_mul_i32(cpu_index, cpu_index, cpu_index);
+    tcg_gen_ext_i32_ptr(cpu_offset, cpu_index);
+    tcg_gen_add_ptr(ptr, ptr, cpu_offset);
+    tcg_gen_ld_i64(val, ptr, 0);
+    tcg_gen_brcond_i64(TCG_COND_EQ, val, val, skip);
+    tcg_temp_free_ptr(cpu_offset);
+    tcg_temp_free_ptr(ptr);
+    tcg_temp_free_i64(val);
+    tcg_temp_free_i32(cpu_index);
+    return skip;
+}
+
+/*
+ * Skip a udata callback unless a per-vCPU counter satisfies a condition.
+ * The cpu_index used by the call is loaded again after the branch, since
+ * TCG temps do not survive it.
+ */
+static void gen_empty_cond_udata_cb(void)
+{
+    TCGv_i32 cpu_index;
+    TCGv_ptr udata;
+    TCGLabel *skip = gen_empty_cond_branch();
+
+    cpu_index = tcg_temp_new_i32();
+    udata = tcg_const_ptr(NULL);
+    tcg_gen_ld_i32(cpu_index, cpu_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    gen_helper_plugin_vcpu_udata_cb(cpu_index, udata);
+    tcg_temp_free_ptr(udata);
+    tcg_temp_free_i32(cpu_index);
+
+    gen_set_label(skip);
+}
+
 static void gen_empty_mem_cb(TCGv addr, uint32_t info)
 {
     do_gen_mem_cb(addr, info);
 }
 
+/*
+ * As gen_empty_cond_udata_cb, for a memory callback.  The branch and
+ * label sit in the middle of a guest instruction, so the temps that are
+ * live across them are made local when the callback is injected, see
+ * plugin_gen_localize_temps().
+ */
+static void gen_empty_cond_mem_cb(TCGv addr, uint32_t info)
+{
+    TCGLabel *skip = gen_empty_cond_branch();
+
+    do_gen_mem_cb(addr, info);
+    gen_set_label(skip);
+}
+
 /*
  * Share the same function for enable/disable. When enabling, the NULL
  * pointer will be overwritten later.
@@ -191,6 +272,7 @@ static void plugin_gen_empty_callback(enum plugin_gen_from from)
     case PLUGIN_GEN_FROM_TB:
         gen_wrapped(from, PLUGIN_GEN_CB_UDATA, gen_empty_udata_cb);
         gen_wrapped(from, PLUGIN_GEN_CB_INLINE, gen_empty_inline_cb);
+        gen_wrapped(from, PLUGIN_GEN_CB_COND_UDATA, gen_empty_cond_udata_cb);
         break;
     default:
         g_assert_not_reached();
@@ -221,11 +303,15 @@ void plugin_gen_empty_mem_callback(TCGv addr, uint32_t info)
 {
     union mem_gen_fn fn;
 
+    /* inline ops come first, so that conditional callbacks see them */
+    fn.inline_fn = gen_empty_inline_cb;
+    gen_mem_wrapped(PLUGIN_GEN_CB_INLINE, &fn, 0, info, false);
+
     fn.mem_fn = gen_empty_mem_cb;
     gen_mem_wrapped(PLUGIN_GEN_CB_MEM, &fn, addr, info, true);
 
-    fn.inline_fn = gen_empty_inline_cb;
-    gen_mem_wrapped(PLUGIN_GEN_CB_INLINE, &fn, 0, info, false);
+    fn.mem_fn = gen_empty_cond_mem_cb;
+    gen_mem_wrapped(PLUGIN_GEN_CB_COND_MEM, &fn, addr, info, true);
 }
 
 static TCGOp *find_op(TCGOp *op, TCGOpcode opc)
@@ -338,6 +424,42 @@ static TCGOp *copy_ld_i64(TCGOp **begin_op, TCGOp *op)
     return op;
 }
 
+static TCGOp *copy_ld_i32(TCGOp **begin_op, TCGOp *op)
+{
+    return copy_op(begin_op, op, INDEX_op_ld_i32);
+}
+
+static TCGOp *copy_mul_i32(TCGOp **begin_op, TCGOp *op, uint32_t v)
+{
+    op = copy_op(begin_op, op, INDEX_op_mul_i32);
+    op->args[2] = tcgv_i32_arg(tcg_constant_i32(v));
+    return op;
+}
+
+static TCGOp *copy_ext_i32_ptr(TCGOp **begin_op, TCGOp *op)
+{
+    if (UINTPTR_MAX == UINT32_MAX) {
+        /* mov_i32 */
+        op = copy_op(begin_op, op, INDEX_op_mov_i32);
+    } else {
+        /* ext_i32_i64 */
+        op = copy_op(begin_op, op, INDEX_op_ext_i32_i64);
+    }
+    return op;
+}
+
+static TCGOp *copy_add_ptr(TCGOp **begin_op, TCGOp *op)
+{
+    if (UINTPTR_MAX == UINT32_MAX) {
+        /* add_i32 */
+        op = copy_op(begin_op, op, INDEX_op_add_i32);
+    } else {
+        /* add_i64 */
+        op = copy_op(begin_op, op, INDEX_op_add_i64);
+    }
+    return op;
+}
+
 static TCGOp *copy_st_i64(TCGOp **begin_op, TCGOp *op)
 {
     if (TCG_TARGET_REG_BITS == 32) {
@@ -378,6 +500,33 @@ static TCGOp *copy_st_ptr(TCGOp **begin_op, TCGOp *op)
     return op;
 }
 
+static TCGOp *copy_brcond_i64(TCGOp **begin_op, TCGOp *op, TCGCond cond,
+                              uint64_t v, TCGLabel *l)
+{
+    if (TCG_TARGET_REG_BITS == 32) {
+        op = copy_op(begin_op, op, INDEX_op_brcond2_i32);
+        op->args[2] = tcgv_i32_arg(tcg_constant_i32(v));
+        op->args[3] = tcgv_i32_arg(tcg_constant_i32(v >> 32));
+        op->args[4] = cond;
+        op->args[5] = label_arg(l);
+    } else {
+        op = copy_op(begin_op, op, INDEX_op_brcond_i64);
+        op->args[1] = tcgv_i64_arg(tcg_constant_i64(v));
+        op->args[2] = cond;
+        op->args[3] = label_arg(l);
+    }
+    l->refs++;
+    return op;
+}
+
+static TCGOp *copy_set_label(TCGOp **begin_op, TCGOp *op, TCGLabel *l)
+{
+    op = copy_op(begin_op, op, INDEX_op_set_label);
+    op->args[0] = label_arg(l);
+    l->present = 1;
+    return op;
+}
+
 static TCGOp *copy_call(TCGOp **begin_op, TCGOp *op, void *empty_func,
                         void *func, int *cb_idx)
 {
@@ -442,8 +591,23 @@ static TCGOp *append_inline_cb(const struct qemu_plugin_dyn_cb *cb,
                                TCGOp *begin_op, TCGOp *op,
                                int *unused)
 {
+    size_t stride;
+    void *ptr = plugin_inline_op_base(cb, &stride);
+
     /* const_ptr */
-    op = copy_const_ptr(&begin_op, op, cb->userp);
+    op = copy_const_ptr(&begin_op, op, ptr);
+
+    /* ld_i32 cpu_index */
+    op = copy_ld_i32(&begin_op, op);
+
+    /* mul_i32 by the stride */
+    op = copy_mul_i32(&begin_op, op, stride);
+
+    /* ext_i32_ptr */
+    op = copy_ext_i32_ptr(&begin_op, op);
+
+    /* add_ptr */
+    op = copy_add_ptr(&begin_op, op);
 
     /* ld_i64 */
     op = copy_ld_i64(&begin_op, op);
@@ -457,6 +621,58 @@ static TCGOp *append_inline_cb(const struct qemu_plugin_dyn_cb *cb,
     return op;
 }
 
+static TCGCond plugin_cond_to_tcg(enum qemu_plugin_cond cond)
+{
+    switch (cond) {
+    case QEMU_PLUGIN_COND_EQ:
+        return TCG_COND_EQ;
+    case QEMU_PLUGIN_COND_NE:
+        return TCG_COND_NE;
+    case QEMU_PLUGIN_COND_LT:
+        return TCG_COND_LTU;
+    case QEMU_PLUGIN_COND_LE:
+        return TCG_COND_LEU;
+    case QEMU_PLUGIN_COND_GT:
+        return TCG_COND_GTU;
+    case QEMU_PLUGIN_COND_GE:
+        return TCG_COND_GEU;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+static TCGOp *append_cond_udata_cb(const struct qemu_plugin_dyn_cb *cb,
+                                   TCGOp *begin_op, TCGOp *op, int *cb_idx)
+{
+    size_t stride;
+    void *ptr = plugin_u64_base(cb->cond.entry, &stride);
+    TCGLabel *skip = gen_new_label();
+
+    /* const_ptr, ld_i32 cpu_index, mul_i32, ext_i32_ptr, add_ptr, ld_i64 */
+    op = copy_const_ptr(&begin_op, op, ptr);
+    op = copy_ld_i32(&begin_op, op);
+    op = copy_mul_i32(&begin_op, op, stride);
+    op = copy_ext_i32_ptr(&begin_op, op);
+    op = copy_add_ptr(&begin_op, op);
+    op = copy_ld_i64(&begin_op, op);
+
+    /* branch over the call if the condition does not hold */
+    op = copy_brcond_i64(&begin_op, op,
+                         tcg_invert_cond(plugin_cond_to_tcg(cb->cond.cond)),
+                         cb->cond.imm, skip);
+
+    /* const_ptr, ld_i32 cpu_index, call */
+    op = copy_const_ptr(&begin_op, op, cb->userp);
+    op = copy_ld_i32(&begin_op, op);
+    op = copy_call(&begin_op, op, HELPER(plugin_vcpu_udata_cb),
+                   cb->f.vcpu_udata, cb_idx);
+
+    /* set_label */
+    op = copy_set_label(&begin_op, op, skip);
+
+    return op;
+}
+
 static TCGOp *append_mem_cb(const struct qemu_plugin_dyn_cb *cb,
                             TCGOp *begin_op, TCGOp *op, int *cb_idx)
 {
@@ -490,6 +706,40 @@ static TCGOp *append_mem_cb(const struct qemu_plugin_dyn_cb *cb,
     return op;
 }
 
+static TCGOp *append_cond_mem_cb(const struct qemu_plugin_dyn_cb *cb,
+                                 TCGOp *begin_op, TCGOp *op, int *cb_idx)
+{
+    size_t stride;
+    void *ptr = plugin_u64_base(cb->cond.entry, &stride);
+    TCGLabel *skip = gen_new_label();
+
+    /* const_ptr, ld_i32 cpu_index, mul_i32, ext_i32_ptr, add_ptr, ld_i64 */
+    op = copy_const_ptr(&begin_op, op, ptr);
+    op = copy_ld_i32(&begin_op, op);
+    op = copy_mul_i32(&begin_op, op, stride);
+    op = copy_ext_i32_ptr(&begin_op, op);
+    op = copy_add_ptr(&begin_op, op);
+    op = copy_ld_i64(&begin_op, op);
+
+    /* branch over the call if the condition does not hold */
+    op = copy_brcond_i64(&begin_op, op,
+                         tcg_invert_cond(plugin_cond_to_tcg(cb->cond.cond)),
+                         cb->cond.imm, skip);
+
+    /* const_i32 info, const_ptr, ld_i32 cpu_index, extu_tl_i64, call */
+    op = copy_op(&begin_op, op, INDEX_op_mov_i32);
+    op = copy_const_ptr(&begin_op, op, cb->userp);
+    op = copy_ld_i32(&begin_op, op);
+    op = copy_extu_tl_i64(&begin_op, op);
+    op = copy_call(&begin_op, op, HELPER(plugin_vcpu_mem_cb),
+                   cb->f.vcpu_udata, cb_idx);
+
+    /* set_label */
+    op = copy_set_label(&begin_op, op, skip);
+
+    return op;
+}
+
 typedef TCGOp *(*inject_fn)(const struct qemu_plugin_dyn_cb *cb,
                             TCGOp *begin_op, TCGOp *op, int *intp);
 typedef bool (*op_ok_fn)(const TCGOp *op, const struct qemu_plugin_dyn_cb *cb);
@@ -548,12 +798,82 @@ inject_inline_cb(const GArray *cbs, TCGOp *begin_op, op_ok_fn ok)
     inject_cb_type(cbs, begin_op, append_inline_cb, ok);
 }
 
+static void
+inject_cond_udata_cb(const GArray *cbs, TCGOp *begin_op)
+{
+    inject_cb_type(cbs, begin_op, append_cond_udata_cb, op_ok);
+}
+
 static void
 inject_mem_cb(const GArray *cbs, TCGOp *begin_op)
 {
     inject_cb_type(cbs, begin_op, append_mem_cb, op_rw);
 }
 
+static void tcg_op_mark_temps(const TCGOp *op, unsigned long *temps)
+{
+    const TCGOpDef *def = &tcg_op_defs[op->opc];
+    int i, n;
+
+    if (op->opc == INDEX_op_call) {
+        n = TCGOP_CALLO(op) + TCGOP_CALLI(op);
+    } else {
+        n = def->nb_oargs + def->nb_iargs;
+    }
+    for (i = 0; i < n; i++) {
+        TCGTemp *ts = arg_temp(op->args[i]);
+
+        if (ts) {
+            set_bit(temp_idx(ts), temps);
+        }
+    }
+}
+
+/*
+ * Normal and EBB temps die at the label of a conditional memory
+ * callback.  Make those of the guest instruction that are used on both
+ * sides of the template at @begin_op, such as the address and the
+ * loaded value, local temps instead.  This is only ever a pessimization
+ * for temps that are not actually live across.
+ */
+static void plugin_gen_localize_temps(TCGOp *begin_op)
+{
+    int n = tcg_ctx->nb_temps;
+    g_autofree unsigned long *before = bitmap_new(n);
+    g_autofree unsigned long *after = bitmap_new(n);
+    TCGOp *op;
+    int i;
+
+    for (op = QTAILQ_PREV(begin_op, link);
+         op && op->opc != INDEX_op_insn_start;
+         op = QTAILQ_PREV(op, link)) {
+        tcg_op_mark_temps(op, before);
+    }
+    for (op = QTAILQ_NEXT(begin_op, link);
+         op && op->opc != INDEX_op_insn_start;
+         op = QTAILQ_NEXT(op, link)) {
+        tcg_op_mark_temps(op, after);
+    }
+
+    bitmap_and(before, before, after, n);
+    for (i = find_first_bit(before, n); i < n;
+         i = find_next_bit(before, n, i + 1)) {
+        TCGTemp *ts = &tcg_ctx->temps[i];
+
+        if (ts->kind == TEMP_NORMAL || ts->kind == TEMP_EBB) {
+            ts->kind = TEMP_LOCAL;
+        }
+    }
+}
+
+static void inject_cond_mem_cb(const GArray *cbs, TCGOp *begin_op)
+{
+    if (cbs && cbs->len) {
+        plugin_gen_localize_temps(begin_op);
+    }
+    inject_cb_type(cbs, begin_op, append_cond_mem_cb, op_rw);
+}
+
 /* we could change the ops in place, but we can reuse more code by copying */
 static void inject_mem_helper(TCGOp *begin_op, GArray *arr)
 {
@@ -588,12 +908,14 @@ static void inject_mem_helper(TCGOp *begin_op, GArray *arr)
 static void inject_mem_enable_helper(struct qemu_plugin_insn *plugin_insn,
                                      TCGOp *begin_op)
 {
-    GArray *cbs[2];
+    GArray *cbs[3];
     GArray *arr;
     size_t n_cbs, i;
 
-    cbs[0] = plugin_insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_REGULAR];
-    cbs[1] = plugin_insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_INLINE];
+    /* in the order the inline path runs them */
+    cbs[0] = plugin_insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_INLINE];
+    cbs[1] = plugin_insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_REGULAR];
+    cbs[2] = plugin_insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_REGULAR_COND];
 
     n_cbs = 0;
     for (i = 0; i < ARRAY_SIZE(cbs); i++) {
@@ -655,6 +977,12 @@ static void plugin_gen_tb_inline(const struct qemu_plugin_tb *ptb,
     inject_inline_cb(ptb->cbs[PLUGIN_CB_INLINE], begin_op, op_ok);
 }
 
+static void plugin_gen_tb_cond_udata(const struct qemu_plugin_tb *ptb,
+                                     TCGOp *begin_op)
+{
+    inject_cond_udata_cb(ptb->cbs[PLUGIN_CB_REGULAR_COND], begin_op);
+}
+
 static void plugin_gen_insn_udata(const struct qemu_plugin_tb *ptb,
                                   TCGOp *begin_op, int insn_idx)
 {
@@ -671,6 +999,15 @@ static void plugin_gen_insn_inline(const struct qemu_plugin_tb *ptb,
                      begin_op, op_ok);
 }
 
+static void plugin_gen_insn_cond_udata(const struct qemu_plugin_tb *ptb,
+                                       TCGOp *begin_op, int insn_idx)
+{
+    struct qemu_plugin_insn *insn = g_ptr_array_index(ptb->insns, insn_idx);
+
+    inject_cond_udata_cb(insn->cbs[PLUGIN_CB_INSN][PLUGIN_CB_REGULAR_COND],
+                         begin_op);
+}
+
 static void plugin_gen_mem_regular(const struct qemu_plugin_tb *ptb,
                                    TCGOp *begin_op, int insn_idx)
 {
@@ -678,6 +1015,15 @@ static void plugin_gen_mem_regular(const struct qemu_plugin_tb *ptb,
     inject_mem_cb(insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_REGULAR], begin_op);
 }
 
+static void plugin_gen_mem_cond(const struct qemu_plugin_tb *ptb,
+                                TCGOp *begin_op, int insn_idx)
+{
+    struct qemu_plugin_insn *insn = g_ptr_array_index(ptb->insns, insn_idx);
+
+    inject_cond_mem_cb(insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_REGULAR_COND],
+                       begin_op);
+}
+
 static void plugin_gen_mem_inline(const struct qemu_plugin_tb *ptb,
                                   TCGOp *begin_op, int insn_idx)
 {
@@ -737,9 +1083,15 @@ static void pr_ops(void)
             case PLUGIN_GEN_CB_INLINE:
                 type = "inline";
                 break;
+            case PLUGIN_GEN_CB_COND_UDATA:
+                type = "cond udata";
+                break;
             case PLUGIN_GEN_CB_MEM:
                 type = "mem";
                 break;
+            case PLUGIN_GEN_CB_COND_MEM:
+                type = "cond mem";
+                break;
             case PLUGIN_GEN_ENABLE_MEM_HELPER:
                 type = "enable mem helper";
                 break;
@@ -785,6 +1137,9 @@ static void plugin_gen_inject(const struct qemu_plugin_tb *plugin_tb)
                 case PLUGIN_GEN_CB_INLINE:
                     plugin_gen_tb_inline(plugin_tb, op);
                     break;
+                case PLUGIN_GEN_CB_COND_UDATA:
+                    plugin_gen_tb_cond_udata(plugin_tb, op);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
@@ -801,6 +1156,9 @@ static void plugin_gen_inject(const struct qemu_plugin_tb *plugin_tb)
                 case PLUGIN_GEN_CB_INLINE:
                     plugin_gen_insn_inline(plugin_tb, op, insn_idx);
                     break;
+                case PLUGIN_GEN_CB_COND_UDATA:
+                    plugin_gen_insn_cond_udata(plugin_tb, op, insn_idx);
+                    break;
                 case PLUGIN_GEN_ENABLE_MEM_HELPER:
                     plugin_gen_enable_mem_helper(plugin_tb, op, insn_idx);
                     break;
@@ -817,6 +1175,9 @@ static void plugin_gen_inject(const struct qemu_plugin_tb *plugin_tb)
                 case PLUGIN_GEN_CB_MEM:
                     plugin_gen_mem_regular(plugin_tb, op, insn_idx);
                     break;
+                case PLUGIN_GEN_CB_COND_MEM:
+                    plugin_gen_mem_cond(plugin_tb, op, insn_idx);
+                    break;
                 case PLUGIN_GEN_CB_INLINE:
                     plugin_gen_mem_inline(plugin_tb, op, insn_idx);
                     break;
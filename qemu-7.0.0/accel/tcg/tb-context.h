@@ -35,6 +35,9 @@ struct TBContext {
     /* statistics */
     unsigned tb_flush_count;
     unsigned tb_phys_invalidate_count;
+    unsigned tier2_count;
+    unsigned tb_partial_flush_count;
+    size_t tb_evicted_regions;
 };
 
 extern TBContext tb_ctx;
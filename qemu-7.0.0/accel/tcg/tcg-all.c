@@ -43,6 +43,11 @@ struct TCGState {
     bool mttcg_enabled;
     int splitwx_enabled;
     unsigned long tb_size;
+    bool tier2;
+    uint32_t tier2_threshold;
+    uint32_t vtlb_size;
+    uint32_t vtlb_ways;
+    bool carry_globals;
 };
 typedef struct TCGState TCGState;
 
@@ -105,9 +110,13 @@ static void tcg_accel_instance_init(Object *obj)
 #else
     s->splitwx_enabled = 0;
 #endif
+    s->tier2_threshold = 1000;
 }
 
 bool mttcg_enabled;
+uint32_t tcg_tier2_threshold;
+uint32_t tcg_vtlb_size;
+uint32_t tcg_vtlb_ways;
 
 static int tcg_init_machine(MachineState *ms)
 {
@@ -121,6 +130,19 @@ static int tcg_init_machine(MachineState *ms)
     tcg_allowed = true;
     mttcg_enabled = s->mttcg_enabled;
 
+    tcg_vtlb_size = s->vtlb_size;
+    tcg_vtlb_ways = s->vtlb_ways;
+    tcg_carry_globals = s->carry_globals;
+
+    if (s->tier2) {
+        if (icount_enabled()) {
+            /* side exits would break the per-TB instruction accounting */
+            warn_report("tier2 is not supported with icount, disabling");
+        } else {
+            tcg_tier2_threshold = MAX(s->tier2_threshold, 2);
+        }
+    }
+
     page_init();
     tb_htable_init();
     tcg_init(s->tb_size * MiB, s->splitwx_enabled, max_cpus);
@@ -195,6 +217,110 @@ static void tcg_set_tb_size(Object *obj, Visitor *v,
     s->tb_size = value;
 }
 
+static bool tcg_get_tier2(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->tier2;
+}
+
+static void tcg_set_tier2(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->tier2 = value;
+}
+
+static void tcg_get_tier2_threshold(Object *obj, Visitor *v,
+                                    const char *name, void *opaque,
+                                    Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->tier2_threshold;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_tier2_threshold(Object *obj, Visitor *v,
+                                    const char *name, void *opaque,
+                                    Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+
+    s->tier2_threshold = value;
+}
+
+static void tcg_get_vtlb_size(Object *obj, Visitor *v,
+                              const char *name, void *opaque,
+                              Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->vtlb_size;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_vtlb_size(Object *obj, Visitor *v,
+                              const char *name, void *opaque,
+                              Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (!is_power_of_2(value) || value > 4096) {
+        error_setg(errp, "vtlb-size must be a power of 2 up to 4096");
+        return;
+    }
+
+    s->vtlb_size = value;
+}
+
+static void tcg_get_vtlb_ways(Object *obj, Visitor *v,
+                              const char *name, void *opaque,
+                              Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->vtlb_ways;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_vtlb_ways(Object *obj, Visitor *v,
+                              const char *name, void *opaque,
+                              Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (!is_power_of_2(value)) {
+        error_setg(errp, "vtlb-ways must be a power of 2");
+        return;
+    }
+
+    s->vtlb_ways = value;
+}
+
+static bool tcg_get_carry_globals(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->carry_globals;
+}
+
+static void tcg_set_carry_globals(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->carry_globals = value;
+}
+
 static bool tcg_get_splitwx(Object *obj, Error **errp)
 {
     TCGState *s = TCG_STATE(obj);
@@ -224,6 +350,34 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
     object_class_property_set_description(oc, "tb-size",
         "TCG translation block cache size");
 
+    object_class_property_add_bool(oc, "tier2",
+        tcg_get_tier2, tcg_set_tier2);
+    object_class_property_set_description(oc, "tier2",
+        "Retranslate hot paths as superblocks");
+
+    object_class_property_add(oc, "tier2-threshold", "int",
+        tcg_get_tier2_threshold, tcg_set_tier2_threshold,
+        NULL, NULL);
+    object_class_property_set_description(oc, "tier2-threshold",
+        "Executions of a TB before it starts a superblock");
+
+    object_class_property_add(oc, "vtlb-size", "int",
+        tcg_get_vtlb_size, tcg_set_vtlb_size,
+        NULL, NULL);
+    object_class_property_set_description(oc, "vtlb-size",
+        "Entries of the victim TLB of each MMU mode");
+
+    object_class_property_add(oc, "vtlb-ways", "int",
+        tcg_get_vtlb_ways, tcg_set_vtlb_ways,
+        NULL, NULL);
+    object_class_property_set_description(oc, "vtlb-ways",
+        "Associativity of the victim TLB");
+
+    object_class_property_add_bool(oc, "carry-globals",
+        tcg_get_carry_globals, tcg_set_carry_globals);
+    object_class_property_set_description(oc, "carry-globals",
+        "Keep guest registers in host registers across branch targets");
+
     object_class_property_add_bool(oc, "split-wx",
         tcg_get_splitwx, tcg_set_splitwx);
     object_class_property_set_description(oc, "split-wx",
@@ -1519,6 +1519,39 @@ void HELPER(gvec_umax64)(void *d, void *a, void *b, uint32_t desc)
     clear_high(d, oprsz, desc);
 }
 
+#define DO_MINMAXS(NAME, TYPE, OP)                                      \
+void HELPER(NAME)(void *d, void *a, uint64_t b, uint32_t desc)          \
+{                                                                       \
+    intptr_t oprsz = simd_oprsz(desc);                                  \
+    TYPE bb = b;                                                        \
+    intptr_t i;                                                         \
+                                                                        \
+    for (i = 0; i < oprsz; i += sizeof(TYPE)) {                         \
+        TYPE aa = *(TYPE *)(a + i);                                     \
+        *(TYPE *)(d + i) = aa OP bb ? aa : bb;                          \
+    }                                                                   \
+    clear_high(d, oprsz, desc);                                         \
+}
+
+DO_MINMAXS(gvec_smins8, int8_t, <)
+DO_MINMAXS(gvec_smins16, int16_t, <)
+DO_MINMAXS(gvec_smins32, int32_t, <)
+DO_MINMAXS(gvec_smins64, int64_t, <)
+DO_MINMAXS(gvec_umins8, uint8_t, <)
+DO_MINMAXS(gvec_umins16, uint16_t, <)
+DO_MINMAXS(gvec_umins32, uint32_t, <)
+DO_MINMAXS(gvec_umins64, uint64_t, <)
+DO_MINMAXS(gvec_smaxs8, int8_t, >)
+DO_MINMAXS(gvec_smaxs16, int16_t, >)
+DO_MINMAXS(gvec_smaxs32, int32_t, >)
+DO_MINMAXS(gvec_smaxs64, int64_t, >)
+DO_MINMAXS(gvec_umaxs8, uint8_t, >)
+DO_MINMAXS(gvec_umaxs16, uint16_t, >)
+DO_MINMAXS(gvec_umaxs32, uint32_t, >)
+DO_MINMAXS(gvec_umaxs64, uint64_t, >)
+
+#undef DO_MINMAXS
+
 void HELPER(gvec_bitsel)(void *d, void *a, void *b, void *c, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
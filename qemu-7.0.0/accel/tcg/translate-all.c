@@ -986,6 +986,7 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
 
     CPU_FOREACH(cpu) {
         cpu_tb_jmp_cache_clear(cpu);
+        cpu->tier2_hot = NULL;
     }
 
     qht_reset_size(&tb_ctx.htable, CODE_GEN_HTABLE_SIZE);
@@ -1003,6 +1004,59 @@ done:
     }
 }
 
+static void tb_evict(TranslationBlock *tb)
+{
+    tb_phys_invalidate(tb, -1);
+}
+
+/*
+ * Make room in code_gen_buffer by evicting its oldest regions, so that
+ * the translations in the younger ones survive.  Fall back to a full
+ * flush when every region is in use by a TCG context.
+ */
+static void do_tb_flush_partial(CPUState *cpu, run_on_cpu_data tb_flush_count)
+{
+    CPUState *other;
+    size_t nr;
+
+    mmap_lock();
+    /* Space was already made on request of another CPU */
+    if (tb_ctx.tb_flush_count != tb_flush_count.host_int ||
+        tcg_region_available()) {
+        mmap_unlock();
+        return;
+    }
+
+    CPU_FOREACH(other) {
+        other->tier2_hot = NULL;
+        /* Evicted TBs are reused memory, not just CF_INVALID */
+        cpu_tb_ras_clear(other);
+    }
+    nr = tcg_region_evict(tb_evict);
+    if (nr) {
+        qatomic_set(&tb_ctx.tb_partial_flush_count,
+                    tb_ctx.tb_partial_flush_count + 1);
+        tb_ctx.tb_evicted_regions += nr;
+    }
+    mmap_unlock();
+
+    if (!nr) {
+        do_tb_flush(cpu, tb_flush_count);
+    }
+}
+
+static void tb_flush_partial(CPUState *cpu)
+{
+    unsigned tb_flush_count = qatomic_mb_read(&tb_ctx.tb_flush_count);
+
+    if (cpu_in_exclusive_context(cpu)) {
+        do_tb_flush_partial(cpu, RUN_ON_CPU_HOST_INT(tb_flush_count));
+    } else {
+        async_safe_run_on_cpu(cpu, do_tb_flush_partial,
+                              RUN_ON_CPU_HOST_INT(tb_flush_count));
+    }
+}
+
 void tb_flush(CPUState *cpu)
 {
     if (tcg_enabled()) {
@@ -1412,8 +1466,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
  buffer_overflow:
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(!tb)) {
-        /* flush must be done */
-        tb_flush(cpu);
+        /* eviction or flush must be done */
+        tb_flush_partial(cpu);
         mmap_unlock();
         /* Make the execution loop process the flush as soon as possible.  */
         cpu->exception_index = EXCP_INTERRUPT;
@@ -1427,6 +1481,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->flags = flags;
     tb->cflags = cflags;
     tb->trace_vcpu_dstate = *cpu->trace_dstate;
+    tb->tier2_count = 0;
     tcg_ctx->tb_cflags = cflags;
  tb_overflow:
 
@@ -1660,6 +1715,72 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     return tb;
 }
 
+static bool tb_tier2_candidate(TranslationBlock *head, TranslationBlock *tb)
+{
+    return tb->cs_base == head->cs_base && tb->flags == head->flags &&
+           tb_cflags(tb) == tb_cflags(head) &&
+           tb->page_addr[0] == head->page_addr[0] &&
+           tb->page_addr[1] == -1 &&
+           ((tb->pc ^ head->pc) & TARGET_PAGE_MASK) == 0;
+}
+
+/*
+ * Called from the main loop when cpu->tier2_hot is set.  Starting from
+ * the hot TB, follow the hotter of its chained successors for as long
+ * as they lie forward in the same page, and retranslate that path as
+ * one superblock replacing the hot TB.  The trace is only a hint for
+ * translator_follow(): the translator checks every edge against the
+ * guest code, so a stale trace costs side exits, not correctness.
+ */
+void tb_tier2_compile(CPUState *cpu, target_ulong pc, target_ulong cs_base,
+                      uint32_t flags, uint32_t cflags)
+{
+    TranslationBlock *hot = cpu->tier2_hot;
+    TranslationBlock *cur = hot;
+    int n = 1;
+
+    cpu->tier2_hot = NULL;
+    if (hot->pc != pc || hot->cs_base != cs_base || hot->flags != flags ||
+        tb_cflags(hot) != cflags || hot->page_addr[0] == -1 ||
+        hot->page_addr[1] != -1) {
+        return;
+    }
+
+    tcg_ctx->tier2_trace[0] = pc;
+    while (n < TCG_TIER2_MAX_BLOCKS) {
+        TranslationBlock *next = NULL;
+        int i;
+
+        for (i = 0; i < 2; i++) {
+            TranslationBlock *dest = (TranslationBlock *)
+                (qatomic_read(&cur->jmp_dest[i]) & ~(uintptr_t)1);
+
+            if (dest && dest->pc >= cur->pc + cur->size &&
+                tb_tier2_candidate(hot, dest) &&
+                qatomic_read(&dest->tier2_count) >= tcg_tier2_threshold / 2 &&
+                (!next || dest->tier2_count > next->tier2_count)) {
+                next = dest;
+            }
+        }
+        if (!next) {
+            break;
+        }
+        tcg_ctx->tier2_trace[n++] = next->pc;
+        cur = next;
+    }
+    if (n == 1) {
+        return;
+    }
+
+    mmap_lock();
+    tb_phys_invalidate(hot, -1);
+    tcg_ctx->tier2_trace_len = n;
+    tb_gen_code(cpu, pc, cs_base, flags, cflags);
+    tcg_ctx->tier2_trace_len = 0;
+    mmap_unlock();
+    qatomic_inc(&tb_ctx.tier2_count);
+}
+
 /*
  * @p must be non-NULL.
  * user-mode: call with mmap_lock held.
@@ -2075,9 +2196,12 @@ void dump_exec_info(GString *buf)
 {
     struct tb_tree_stats tst = {};
     struct qht_stats hst;
+    TCGRegAllocStats ras;
     size_t nb_tbs, flush_full, flush_part, flush_elide;
+    size_t large_flush, large_merge;
 
     tcg_tb_foreach(tb_tree_stats_iter, &tst);
+    tcg_regalloc_stats(&ras);
     nb_tbs = tst.nb_tbs;
     /* XXX: avoid using doubles ? */
     g_string_append_printf(buf, "Translation buffer state:\n");
@@ -2106,6 +2230,17 @@ void dump_exec_info(GString *buf)
                            nb_tbs ? (tst.direct_jmp_count * 100) / nb_tbs : 0,
                            tst.direct_jmp2_count,
                            nb_tbs ? (tst.direct_jmp2_count * 100) / nb_tbs : 0);
+    /* Counted at translation, so including TBs since flushed */
+    g_string_append_printf(buf, "TB avg spills       %0.1f global loads, "
+                           "%0.1f global stores\n",
+                           ras.tbs ? (double)ras.global_loads / ras.tbs : 0,
+                           ras.tbs ? (double)ras.global_stores / ras.tbs : 0);
+    if (tcg_carry_globals) {
+        g_string_append_printf(buf, "TB avg carries      %0.1f globals kept "
+                               "in registers across labels\n",
+                               ras.tbs ?
+                               (double)ras.label_carries / ras.tbs : 0);
+    }
 
     qht_statistics_init(&tb_ctx.htable, &hst);
     print_qht_statistics(hst, buf);
@@ -2114,13 +2249,23 @@ void dump_exec_info(GString *buf)
     g_string_append_printf(buf, "\nStatistics:\n");
     g_string_append_printf(buf, "TB flush count      %u\n",
                            qatomic_read(&tb_ctx.tb_flush_count));
+    g_string_append_printf(buf, "TB partial flushes  %u (%zu regions)\n",
+                           qatomic_read(&tb_ctx.tb_partial_flush_count),
+                           tb_ctx.tb_evicted_regions);
     g_string_append_printf(buf, "TB invalidate count %u\n",
                            qatomic_read(&tb_ctx.tb_phys_invalidate_count));
+    if (tcg_tier2_threshold) {
+        g_string_append_printf(buf, "TB tier-2 count     %u\n",
+                               qatomic_read(&tb_ctx.tier2_count));
+    }
 
     tlb_flush_counts(&flush_full, &flush_part, &flush_elide);
     g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
     g_string_append_printf(buf, "TLB partial flushes %zu\n", flush_part);
     g_string_append_printf(buf, "TLB elided flushes  %zu\n", flush_elide);
+    tlb_large_page_counts(&large_flush, &large_merge);
+    g_string_append_printf(buf, "TLB large page flushes %zu (%zu merges)\n",
+                           large_flush, large_merge);
     tcg_dump_info(buf);
 }
 
@@ -17,6 +17,8 @@
 #include "exec/translator.h"
 #include "exec/plugin-gen.h"
 #include "sysemu/replay.h"
+#include "tb-hash.h"
+#include "internal.h"
 
 /* Pairs with tcg_clear_temp_count.
    To be called by #TranslatorOps.{translate_insn,tb_stop} if
@@ -42,6 +44,186 @@ bool translator_use_goto_tb(DisasContextBase *db, target_ulong dest)
     return ((db->pc_first ^ dest) & TARGET_PAGE_MASK) == 0;
 }
 
+bool translator_follow(DisasContextBase *db, target_ulong dest)
+{
+    if (db->trace_next >= db->trace_len ||
+        db->trace[db->trace_next] != dest) {
+        return false;
+    }
+    /*
+     * Only move forward within the first page, so that [pc_first,
+     * pc_next) still covers every translated instruction for SMC
+     * detection and tb->size.
+     */
+    if (dest <= db->pc_next || ((db->pc_first ^ dest) & TARGET_PAGE_MASK)) {
+        return false;
+    }
+    if (db->num_insns >= db->max_insns || tcg_op_buf_full()) {
+        return false;
+    }
+    db->trace_next++;
+    return true;
+}
+
+/*
+ * Shadow return stack.  A call pushes the TB that tb_jmp_cache holds for
+ * its return address, and the matching return checks it inline instead
+ * of calling helper_lookup_tb_ptr.  The stack is cleared together with
+ * tb_jmp_cache, so that it never holds a TB whose memory was reused or
+ * whose virtual mapping changed; TBs invalidated in the meantime fail
+ * the cflags comparison because of CF_INVALID.
+ */
+#define RAS_OFS(field) \
+    (offsetof(ArchCPU, parent_obj.field) - offsetof(ArchCPU, env))
+
+static bool translator_use_ras(DisasContextBase *db)
+{
+    return !(tb_cflags(db->tb) & (CF_NO_GOTO_PTR | CF_SINGLE_STEP |
+                                  CF_LAST_IO | CF_NOIRQ | CF_COUNT_MASK));
+}
+
+/* Load the address of tb_ras[top] into @slot */
+static void gen_ras_slot(TCGv_ptr slot, TCGv_i32 top)
+{
+    TCGv_i32 t = tcg_temp_new_i32();
+
+    tcg_gen_muli_i32(t, top, sizeof(TranslationBlock *));
+    tcg_gen_ext_i32_ptr(slot, t);
+    tcg_gen_add_ptr(slot, slot, cpu_env);
+    tcg_temp_free_i32(t);
+}
+
+void translator_ras_push(DisasContextBase *db, target_ulong ret_pc)
+{
+    TCGv_i32 top;
+    TCGv_ptr slot, tb;
+
+    if (!translator_use_ras(db)) {
+        return;
+    }
+
+    top = tcg_temp_new_i32();
+    slot = tcg_temp_new_ptr();
+    tb = tcg_temp_new_ptr();
+
+    tcg_gen_ld_ptr(tb, cpu_env, RAS_OFS(tb_jmp_cache) +
+                   tb_jmp_cache_hash_func(ret_pc) * sizeof(TranslationBlock *));
+    tcg_gen_ld_i32(top, cpu_env, RAS_OFS(tb_ras_top));
+    gen_ras_slot(slot, top);
+    tcg_gen_st_ptr(tb, slot, RAS_OFS(tb_ras));
+    tcg_gen_addi_i32(top, top, 1);
+    tcg_gen_andi_i32(top, top, TB_RAS_SIZE - 1);
+    tcg_gen_st_i32(top, cpu_env, RAS_OFS(tb_ras_top));
+
+    tcg_temp_free_ptr(tb);
+    tcg_temp_free_ptr(slot);
+    tcg_temp_free_i32(top);
+}
+
+void translator_ras_pop(DisasContextBase *db)
+{
+    TCGv_i32 top;
+
+    if (!translator_use_ras(db)) {
+        return;
+    }
+
+    top = tcg_temp_new_i32();
+    tcg_gen_ld_i32(top, cpu_env, RAS_OFS(tb_ras_top));
+    tcg_gen_subi_i32(top, top, 1);
+    tcg_gen_andi_i32(top, top, TB_RAS_SIZE - 1);
+    tcg_gen_st_i32(top, cpu_env, RAS_OFS(tb_ras_top));
+    tcg_temp_free_i32(top);
+}
+
+void translator_ras_return(DisasContextBase *db, TCGv dest,
+                           target_ulong cs_base, uint32_t flags)
+{
+    TCGLabel *miss;
+    TCGv_i32 top, t32;
+    TCGv_ptr tb, ptr;
+    TCGv t;
+
+    if (!translator_use_ras(db)) {
+        tcg_gen_lookup_and_goto_ptr();
+        return;
+    }
+
+    miss = gen_new_label();
+    tb = tcg_temp_local_new_ptr();
+
+    top = tcg_temp_new_i32();
+    tcg_gen_ld_i32(top, cpu_env, RAS_OFS(tb_ras_top));
+    tcg_gen_subi_i32(top, top, 1);
+    tcg_gen_andi_i32(top, top, TB_RAS_SIZE - 1);
+    tcg_gen_st_i32(top, cpu_env, RAS_OFS(tb_ras_top));
+    gen_ras_slot(tb, top);
+    tcg_gen_ld_ptr(tb, tb, RAS_OFS(tb_ras));
+    tcg_temp_free_i32(top);
+    tcg_gen_brcondi_ptr(TCG_COND_EQ, tb, 0, miss);
+
+    /* Same checks as tb_lookup(), against values known at translation */
+    t = tcg_temp_new();
+    tcg_gen_ld_tl(t, tb, offsetof(TranslationBlock, pc));
+    tcg_gen_brcond_tl(TCG_COND_NE, t, dest, miss);
+    tcg_temp_free(t);
+
+    t = tcg_temp_new();
+    tcg_gen_ld_tl(t, tb, offsetof(TranslationBlock, cs_base));
+    tcg_gen_brcondi_tl(TCG_COND_NE, t, cs_base, miss);
+    tcg_temp_free(t);
+
+    t32 = tcg_temp_new_i32();
+    tcg_gen_ld_i32(t32, tb, offsetof(TranslationBlock, flags));
+    tcg_gen_brcondi_i32(TCG_COND_NE, t32, flags, miss);
+    tcg_temp_free_i32(t32);
+
+    t32 = tcg_temp_new_i32();
+    tcg_gen_ld_i32(t32, tb, offsetof(TranslationBlock, cflags));
+    tcg_gen_brcondi_i32(TCG_COND_NE, t32, tb_cflags(db->tb), miss);
+    tcg_temp_free_i32(t32);
+
+    ptr = tcg_temp_new_ptr();
+    tcg_gen_ld_ptr(ptr, tb, offsetof(TranslationBlock, tc.ptr));
+    plugin_gen_disable_mem_helpers();
+    tcg_gen_op1i(INDEX_op_goto_ptr, tcgv_ptr_arg(ptr));
+    tcg_temp_free_ptr(ptr);
+    tcg_temp_free_ptr(tb);
+
+    gen_set_label(miss);
+    tcg_gen_lookup_and_goto_ptr();
+}
+
+/*
+ * Count executions of a tier-1 TB.  When the count reaches the
+ * threshold, record the TB in CPUState and leave through the exit
+ * request path of gen_tb_start(), before the first instruction, so
+ * that the main loop builds the superblock with the CPU at tb->pc.
+ */
+static void gen_tier2_count(TranslationBlock *tb)
+{
+    TCGv_ptr ptr = tcg_const_ptr(&tb->tier2_count);
+    TCGv_i32 count = tcg_temp_new_i32();
+    TCGLabel *l = gen_new_label();
+
+    tcg_gen_ld_i32(count, ptr, 0);
+    tcg_gen_addi_i32(count, count, 1);
+    tcg_gen_st_i32(count, ptr, 0);
+    tcg_gen_brcondi_i32(TCG_COND_NE, count, tcg_tier2_threshold, l);
+
+    tcg_gen_st_ptr(tcg_constant_ptr(tb), cpu_env,
+                   offsetof(ArchCPU, parent_obj.tier2_hot) -
+                   offsetof(ArchCPU, env));
+    tcg_gen_st16_i32(tcg_constant_i32(-1), cpu_env,
+                     offsetof(ArchCPU, neg.icount_decr.u16.high) -
+                     offsetof(ArchCPU, env));
+    tcg_gen_exit_tb(tb, TB_EXIT_REQUESTED);
+
+    gen_set_label(l);
+    tcg_temp_free_i32(count);
+    tcg_temp_free_ptr(ptr);
+}
+
 static inline void translator_page_protect(DisasContextBase *dcbase,
                                            target_ulong pc)
 {
@@ -65,6 +247,12 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
     db->num_insns = 0;
     db->max_insns = max_insns;
     db->singlestep_enabled = cflags & CF_SINGLE_STEP;
+    db->trace_len = 0;
+    db->trace_next = 1;
+    if (tcg_ctx->tier2_trace_len && tcg_ctx->tier2_trace[0] == tb->pc) {
+        db->trace = tcg_ctx->tier2_trace;
+        db->trace_len = tcg_ctx->tier2_trace_len;
+    }
     translator_page_protect(db, db->pc_next);
 
     ops->init_disas_context(db, cpu);
@@ -75,6 +263,9 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
 
     /* Start translating.  */
     gen_tb_start(db->tb);
+    if (tcg_tier2_threshold && !db->trace_len && !(cflags & CF_NOIRQ)) {
+        gen_tier2_count(tb);
+    }
     ops->tb_start(db, cpu);
     tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
 
@@ -28,6 +28,14 @@ static int limit = 50;
 static enum qemu_plugin_mem_rw rw = QEMU_PLUGIN_MEM_RW;
 static bool track_io;
 
+/*
+ * With sample=N only one access in N is looked up: the generated code
+ * counts the accesses of each vCPU and only calls vcpu_haddr() when the
+ * count reaches N.
+ */
+static uint64_t sample_period = 1;
+static qemu_plugin_u64 sample_count;
+
 enum sort_type {
     SORT_RW = 0,
     SORT_R,
@@ -138,16 +146,23 @@ static void vcpu_haddr(unsigned int cpu_index, qemu_plugin_meminfo_t meminfo,
         g_hash_table_insert(pages, GUINT_TO_POINTER(page), (gpointer) count);
     }
     if (qemu_plugin_mem_is_store(meminfo)) {
-        count->writes++;
+        count->writes += sample_period;
         count->cpu_write |= (1 << cpu_index);
     } else {
-        count->reads++;
+        count->reads += sample_period;
         count->cpu_read |= (1 << cpu_index);
     }
 
     g_mutex_unlock(&lock);
 }
 
+static void vcpu_sample(unsigned int cpu_index, qemu_plugin_meminfo_t meminfo,
+                        uint64_t vaddr, void *udata)
+{
+    qemu_plugin_u64_set(sample_count, cpu_index, 0);
+    vcpu_haddr(cpu_index, meminfo, vaddr, udata);
+}
+
 static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
 {
     size_t n = qemu_plugin_tb_n_insns(tb);
@@ -155,9 +170,20 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
 
     for (i = 0; i < n; i++) {
         struct qemu_plugin_insn *insn = qemu_plugin_tb_get_insn(tb, i);
-        qemu_plugin_register_vcpu_mem_cb(insn, vcpu_haddr,
-                                         QEMU_PLUGIN_CB_NO_REGS,
-                                         rw, NULL);
+
+        if (sample_period == 1) {
+            qemu_plugin_register_vcpu_mem_cb(insn, vcpu_haddr,
+                                             QEMU_PLUGIN_CB_NO_REGS,
+                                             rw, NULL);
+            continue;
+        }
+        qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+            insn, rw, QEMU_PLUGIN_INLINE_ADD_U64, sample_count, 1);
+        qemu_plugin_register_vcpu_mem_cond_cb(insn, vcpu_sample,
+                                              QEMU_PLUGIN_CB_NO_REGS, rw,
+                                              QEMU_PLUGIN_COND_GE,
+                                              sample_count, sample_period,
+                                              NULL);
     }
 }
 
@@ -189,6 +215,12 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
             }
         } else if (g_strcmp0(tokens[0], "pagesize") == 0) {
             page_size = g_ascii_strtoull(tokens[1], NULL, 10);
+        } else if (g_strcmp0(tokens[0], "sample") == 0) {
+            sample_period = g_ascii_strtoull(tokens[1], NULL, 10);
+            if (sample_period == 0) {
+                fprintf(stderr, "invalid value to sample: %s\n", tokens[1]);
+                return -1;
+            }
         } else {
             fprintf(stderr, "option parsing failed: %s\n", opt);
             return -1;
@@ -196,6 +228,10 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
     }
 
     plugin_init();
+    if (sample_period > 1) {
+        sample_count = qemu_plugin_scoreboard_u64(
+            qemu_plugin_scoreboard_new(sizeof(uint64_t)));
+    }
 
     qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
     qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
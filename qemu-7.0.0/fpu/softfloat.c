@@ -237,7 +237,8 @@ static inline bool can_use_fpu(const float_status *s)
     if (QEMU_NO_HARDFLOAT) {
         return false;
     }
-    return likely(s->float_exception_flags & float_flag_inexact &&
+    return likely((s->float_exception_flags & float_flag_inexact ||
+                   s->inexact_in_host) &&
                   s->float_rounding_mode == float_round_nearest_even);
 }
 
@@ -207,7 +207,8 @@ SRST
 ERST
 
 #if defined(TARGET_I386) || defined(TARGET_SH4) || defined(TARGET_SPARC) || \
-    defined(TARGET_PPC) || defined(TARGET_XTENSA) || defined(TARGET_M68K)
+    defined(TARGET_PPC) || defined(TARGET_XTENSA) || defined(TARGET_M68K) || \
+    defined(TARGET_RISCV)
     {
         .name       = "tlb",
         .args_type  = "",
@@ -219,7 +220,9 @@ ERST
 
 SRST
   ``info tlb``
-    Show virtual to physical memory mappings.
+    Show virtual to physical memory mappings.  On RISC-V, show TLB
+    maintenance, ASID slot and page-walk cache statistics of the current
+    CPU instead.
 ERST
 
 #if defined(TARGET_I386) || defined(TARGET_RISCV)
@@ -281,6 +284,20 @@ SRST
     Show dynamic compiler opcode counters
 ERST
 
+#if defined(CONFIG_TCG)
+    {
+        .name       = "vtlb",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show victim TLB statistics per MMU mode",
+    },
+#endif
+
+SRST
+  ``info vtlb``
+    Show victim TLB size and hits, misses and fills per MMU mode.
+ERST
+
     {
         .name       = "sync-profile",
         .args_type  = "mean:-m,no_coalesce:-n,max:i?",
@@ -229,27 +229,194 @@ static gboolean serial_watch_cb(void *do_not_use, GIOCondition cond,
     return FALSE;
 }
 
+/* Move the next byte from THR or the transmit FIFO into the TSR. */
+static void serial_load_tsr(SerialState *s)
+{
+    assert(!(s->lsr & UART_LSR_THRE));
+
+    if (s->fcr & UART_FCR_FE) {
+        assert(!fifo8_is_empty(&s->xmit_fifo));
+        s->tsr = fifo8_pop(&s->xmit_fifo);
+        if (!s->xmit_fifo.num) {
+            s->lsr |= UART_LSR_THRE;
+        }
+    } else {
+        s->tsr = s->thr;
+        s->lsr |= UART_LSR_THRE;
+    }
+    if ((s->lsr & UART_LSR_THRE) && !s->thr_ipending) {
+        s->thr_ipending = 1;
+        serial_update_irq(s);
+    }
+}
+
+/*
+ * fast-tx: instead of one chardev write per transmitted byte, bytes are
+ * collected in tx_buf and handed to the backend in a single write from
+ * a bottom half, i.e. once the vCPU stops poking THR.  Without
+ * fast-tx-pace the transmitter drains immediately, so a guest polling
+ * LSR.THRE never waits; with it, bytes leave THR/FIFO at one per
+ * char_transmit_time on average as on real hardware.  To keep output
+ * batched, the pacing timer only runs every SERIAL_TX_PACE_NS while the
+ * FIFO is busy and moves all the bytes that became due meanwhile.
+ */
+#define SERIAL_TX_PACE_NS   (1 * SCALE_MS)
+
+static void serial_fast_xmit(SerialState *s);
+
+static void serial_tx_flush(SerialState *s);
+
+static gboolean serial_tx_watch_cb(void *do_not_use, GIOCondition cond,
+                                   void *opaque)
+{
+    SerialState *s = opaque;
+    s->tx_watch_tag = 0;
+    serial_tx_flush(s);
+    if (!(s->lsr & UART_LSR_THRE)) {
+        serial_fast_xmit(s);
+    }
+    return FALSE;
+}
+
+static void serial_tx_flush(SerialState *s)
+{
+    int rc;
+
+    if (!s->tx_len || s->tx_watch_tag > 0) {
+        return;
+    }
+    if (!qemu_chr_fe_backend_connected(&s->chr)) {
+        s->tx_len = 0;
+        return;
+    }
+
+    rc = qemu_chr_fe_write(&s->chr, s->tx_buf, s->tx_len);
+    if (rc < 0 && errno != EAGAIN) {
+        /* Backend error: drop the data like the byte-at-a-time path does */
+        s->tx_len = 0;
+        return;
+    }
+    if (rc > 0) {
+        s->tx_writes++;
+        s->tx_bytes += rc;
+        s->tx_len -= rc;
+        memmove(s->tx_buf, s->tx_buf + rc, s->tx_len);
+    }
+    trace_serial_fast_tx_flush(rc, s->tx_len, s->tx_bytes, s->tx_writes);
+
+    if (s->tx_len) {
+        s->tx_watch_tag = qemu_chr_fe_add_watch(&s->chr, G_IO_OUT | G_IO_HUP,
+                                                serial_tx_watch_cb, s);
+        if (s->tx_watch_tag == 0) {
+            s->tx_len = 0;
+        }
+    }
+}
+
+static void serial_tx_bh(void *opaque)
+{
+    serial_tx_flush(opaque);
+}
+
+/*
+ * Move up to @max bytes from THR/FIFO into tx_buf.  When tx_buf is full
+ * and the backend cannot take it, stop and leave the rest in the FIFO;
+ * serial_tx_watch_cb resumes once the backend is writable again.
+ */
+static void serial_tx_fill(SerialState *s, unsigned int max)
+{
+    while (max && !(s->lsr & UART_LSR_THRE)) {
+        if (s->tx_len == SERIAL_TX_BUF_SIZE) {
+            serial_tx_flush(s);
+            if (s->tx_len == SERIAL_TX_BUF_SIZE) {
+                return;
+            }
+        }
+        serial_load_tsr(s);
+        s->tx_buf[s->tx_len++] = s->tsr;
+        max--;
+    }
+
+    if ((s->lsr & UART_LSR_THRE) && !(s->lsr & UART_LSR_TEMT)) {
+        s->last_xmit_ts = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+        s->lsr |= UART_LSR_TEMT;
+    }
+    if (s->tx_len) {
+        qemu_bh_schedule(s->tx_bh);
+    }
+}
+
+static void serial_tx_pace_cb(void *opaque)
+{
+    SerialState *s = opaque;
+    uint64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    uint64_t ctt = MAX(s->char_transmit_time, 1);
+    uint64_t due = (now - s->tx_pace_ts) / ctt;
+
+    /* The remainder carries over, so the average rate is the baud rate */
+    s->tx_pace_ts += due * ctt;
+    serial_tx_fill(s, MIN(due, UINT_MAX));
+    if (!(s->lsr & UART_LSR_THRE) && s->tx_watch_tag == 0) {
+        timer_mod(s->tx_pace_timer, now + MAX(ctt, SERIAL_TX_PACE_NS));
+    }
+}
+
+static void serial_fast_xmit(SerialState *s)
+{
+    if (!s->fast_tx_pace) {
+        serial_tx_fill(s, UINT_MAX);
+    } else if (!timer_pending(s->tx_pace_timer)) {
+        /* The first byte still takes a single char_transmit_time */
+        s->tx_pace_ts = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+        timer_mod(s->tx_pace_timer, s->tx_pace_ts + s->char_transmit_time);
+    }
+}
+
+/*
+ * Synchronously write out everything fast-tx still holds, including
+ * bytes waiting in THR/FIFO, and leave the transmitter empty.
+ */
+static void serial_tx_drain(SerialState *s)
+{
+    if (s->tx_watch_tag > 0) {
+        g_source_remove(s->tx_watch_tag);
+        s->tx_watch_tag = 0;
+    }
+    timer_del(s->tx_pace_timer);
+
+    do {
+        while (!(s->lsr & UART_LSR_THRE) && s->tx_len < SERIAL_TX_BUF_SIZE) {
+            serial_load_tsr(s);
+            s->tx_buf[s->tx_len++] = s->tsr;
+        }
+        if (s->tx_len) {
+            int rc = qemu_chr_fe_write_all(&s->chr, s->tx_buf, s->tx_len);
+            if (rc > 0) {
+                s->tx_writes++;
+                s->tx_bytes += rc;
+            }
+            s->tx_len = 0;
+        }
+    } while (!(s->lsr & UART_LSR_THRE));
+
+    if (!(s->lsr & UART_LSR_TEMT)) {
+        s->last_xmit_ts = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+        s->lsr |= UART_LSR_TEMT;
+    }
+}
+
 static void serial_xmit(SerialState *s)
 {
+    if (s->fast_tx && !(s->mcr & UART_MCR_LOOP)) {
+        assert(s->tsr_retry == 0);
+        serial_fast_xmit(s);
+        return;
+    }
+
     do {
         assert(!(s->lsr & UART_LSR_TEMT));
         if (s->tsr_retry == 0) {
-            assert(!(s->lsr & UART_LSR_THRE));
-
-            if (s->fcr & UART_FCR_FE) {
-                assert(!fifo8_is_empty(&s->xmit_fifo));
-                s->tsr = fifo8_pop(&s->xmit_fifo);
-                if (!s->xmit_fifo.num) {
-                    s->lsr |= UART_LSR_THRE;
-                }
-            } else {
-                s->tsr = s->thr;
-                s->lsr |= UART_LSR_THRE;
-            }
-            if ((s->lsr & UART_LSR_THRE) && !s->thr_ipending) {
-                s->thr_ipending = 1;
-                serial_update_irq(s);
-            }
+            serial_load_tsr(s);
         }
 
         if (s->mcr & UART_MCR_LOOP) {
@@ -631,6 +798,11 @@ static void serial_event(void *opaque, QEMUChrEvent event)
 static int serial_pre_save(void *opaque)
 {
     SerialState *s = opaque;
+
+    /* tx_buf and the pacing timer are not migrated */
+    if (s->fast_tx) {
+        serial_tx_drain(s);
+    }
     s->fcr_vmstate = s->fcr;
 
     return 0;
@@ -874,6 +1046,8 @@ static void serial_reset(void *opaque)
     s->char_transmit_time = (NANOSECONDS_PER_SECOND / 9600) * 10;
     s->poll_msl = 0;
 
+    serial_tx_drain(s);
+
     s->timeout_ipending = 0;
     timer_del(s->fifo_timeout_timer);
     timer_del(s->modem_status_poll);
@@ -926,6 +1100,8 @@ static void serial_realize(DeviceState *dev, Error **errp)
     s->modem_status_poll = timer_new_ns(QEMU_CLOCK_VIRTUAL, (QEMUTimerCB *) serial_update_msl, s);
 
     s->fifo_timeout_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, (QEMUTimerCB *) fifo_timeout_int, s);
+    s->tx_pace_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, serial_tx_pace_cb, s);
+    s->tx_bh = qemu_bh_new(serial_tx_bh, s);
     qemu_register_reset(serial_reset, s);
 
     qemu_chr_fe_set_handlers(&s->chr, serial_can_receive1, serial_receive1,
@@ -945,6 +1121,12 @@ static void serial_unrealize(DeviceState *dev)
 
     timer_free(s->fifo_timeout_timer);
 
+    timer_free(s->tx_pace_timer);
+    qemu_bh_delete(s->tx_bh);
+    if (s->tx_watch_tag > 0) {
+        g_source_remove(s->tx_watch_tag);
+    }
+
     fifo8_destroy(&s->recv_fifo);
     fifo8_destroy(&s->xmit_fifo);
 
@@ -972,9 +1154,22 @@ static Property serial_properties[] = {
     DEFINE_PROP_CHR("chardev", SerialState, chr),
     DEFINE_PROP_UINT32("baudbase", SerialState, baudbase, 115200),
     DEFINE_PROP_BOOL("wakeup", SerialState, wakeup, false),
+    DEFINE_PROP_BOOL("fast-tx", SerialState, fast_tx, false),
+    DEFINE_PROP_BOOL("fast-tx-pace", SerialState, fast_tx_pace, false),
     DEFINE_PROP_END_OF_LIST(),
 };
 
+static void serial_instance_init(Object *o)
+{
+    SerialState *s = SERIAL(o);
+
+    /* fast-tx-bytes minus fast-tx-writes is the number of writes saved */
+    object_property_add_uint64_ptr(o, "fast-tx-bytes", &s->tx_bytes,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(o, "fast-tx-writes", &s->tx_writes,
+                                   OBJ_PROP_FLAG_READ);
+}
+
 static void serial_class_init(ObjectClass *klass, void* data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
@@ -990,6 +1185,7 @@ static const TypeInfo serial_info = {
     .name = TYPE_SERIAL,
     .parent = TYPE_DEVICE,
     .instance_size = sizeof(SerialState),
+    .instance_init = serial_instance_init,
     .class_init = serial_class_init,
 };
 
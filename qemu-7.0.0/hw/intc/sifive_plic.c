@@ -22,6 +22,7 @@
 #include "qapi/error.h"
 #include "qemu/log.h"
 #include "qemu/module.h"
+#include "qemu/main-loop.h"
 #include "qemu/error-report.h"
 #include "hw/sysbus.h"
 #include "hw/pci/msi.h"
@@ -63,46 +64,139 @@ static uint32_t atomic_set_masked(uint32_t *a, uint32_t mask, uint32_t value)
     return old;
 }
 
-static void sifive_plic_set_pending(SiFivePLICState *plic, int irq, bool level)
+static uint32_t *sifive_plic_ready(SiFivePLICState *plic, uint32_t addrid,
+                                   uint32_t prio)
 {
-    atomic_set_masked(&plic->pending[irq >> 5], 1 << (irq & 31), -!!level);
+    return &plic->ready[(addrid * (SIFIVE_PLIC_MAX_PRIORITY + 1) + prio) *
+                        plic->bitfield_words];
 }
 
-static void sifive_plic_set_claimed(SiFivePLICState *plic, int irq, bool level)
+static bool sifive_plic_irq_ready(SiFivePLICState *plic, int irq)
 {
-    atomic_set_masked(&plic->claimed[irq >> 5], 1 << (irq & 31), -!!level);
+    uint32_t bit = 1 << (irq & 31);
+
+    return plic->source_priority[irq] &&
+           (plic->pending[irq >> 5] & ~plic->claimed[irq >> 5] & bit);
 }
 
-static uint32_t sifive_plic_claimed(SiFivePLICState *plic, uint32_t addrid)
+/* Drop @irq from the ready bitmaps of every context */
+static void sifive_plic_ready_del(SiFivePLICState *plic, int irq)
 {
-    uint32_t max_irq = 0;
-    uint32_t max_prio = plic->target_priority[addrid];
-    int i, j;
+    uint32_t prio = plic->source_priority[irq];
+    uint32_t bit = 1 << (irq & 31);
+    int addrid, i;
 
-    for (i = 0; i < plic->bitfield_words; i++) {
-        uint32_t pending_enabled_not_claimed =
-                        (plic->pending[i] & ~plic->claimed[i]) &
-                            plic->enable[addrid * plic->bitfield_words + i];
+    if (!prio) {
+        return;
+    }
 
-        if (!pending_enabled_not_claimed) {
+    for (addrid = 0; addrid < plic->num_addrs; addrid++) {
+        uint32_t *ready = sifive_plic_ready(plic, addrid, prio);
+
+        if (!(ready[irq >> 5] & bit)) {
             continue;
         }
+        ready[irq >> 5] &= ~bit;
+
+        /* Clear the summary bit if no source of this priority is left */
+        i = 0;
+        while (i < plic->bitfield_words && !ready[i]) {
+            i++;
+        }
+        if (i == plic->bitfield_words) {
+            plic->ready_prio[addrid] &= ~(1 << prio);
+        }
+    }
+}
+
+/* Add @irq to the ready bitmaps of the contexts that have it enabled */
+static void sifive_plic_ready_add(SiFivePLICState *plic, int irq)
+{
+    uint32_t prio = plic->source_priority[irq];
+    uint32_t bit = 1 << (irq & 31);
+    int addrid;
+
+    if (!sifive_plic_irq_ready(plic, irq)) {
+        return;
+    }
+
+    for (addrid = 0; addrid < plic->num_addrs; addrid++) {
+        if (plic->enable[addrid * plic->bitfield_words + (irq >> 5)] & bit) {
+            sifive_plic_ready(plic, addrid, prio)[irq >> 5] |= bit;
+            plic->ready_prio[addrid] |= 1 << prio;
+        }
+    }
+}
+
+/* Recompute the ready bitmaps of one context from scratch */
+static void sifive_plic_ready_rebuild(SiFivePLICState *plic, uint32_t addrid)
+{
+    int prio, i;
+
+    memset(sifive_plic_ready(plic, addrid, 0), 0,
+           (SIFIVE_PLIC_MAX_PRIORITY + 1) * plic->bitfield_words *
+           sizeof(uint32_t));
+    plic->ready_prio[addrid] = 0;
 
-        for (j = 0; j < 32; j++) {
-            int irq = (i << 5) + j;
-            uint32_t prio = plic->source_priority[irq];
-            int enabled = pending_enabled_not_claimed & (1 << j);
+    for (i = 0; i < plic->bitfield_words; i++) {
+        uint32_t bits = plic->pending[i] & ~plic->claimed[i] &
+                        plic->enable[addrid * plic->bitfield_words + i];
+
+        while (bits) {
+            int irq = (i << 5) + ctz32(bits);
 
-            if (enabled && prio > max_prio) {
-                max_irq = irq;
-                max_prio = prio;
+            bits &= bits - 1;
+            prio = plic->source_priority[irq];
+            if (prio) {
+                sifive_plic_ready(plic, addrid, prio)[i] |= 1 << (irq & 31);
+                plic->ready_prio[addrid] |= 1 << prio;
             }
         }
     }
+}
 
-    return max_irq;
+static void sifive_plic_set_pending(SiFivePLICState *plic, int irq, bool level)
+{
+    sifive_plic_ready_del(plic, irq);
+    atomic_set_masked(&plic->pending[irq >> 5], 1 << (irq & 31), -!!level);
+    sifive_plic_ready_add(plic, irq);
+}
+
+static void sifive_plic_set_claimed(SiFivePLICState *plic, int irq, bool level)
+{
+    sifive_plic_ready_del(plic, irq);
+    atomic_set_masked(&plic->claimed[irq >> 5], 1 << (irq & 31), -!!level);
+    sifive_plic_ready_add(plic, irq);
 }
 
+static uint32_t sifive_plic_claimed(SiFivePLICState *plic, uint32_t addrid)
+{
+    /* Only priorities above the threshold can interrupt */
+    uint32_t prios = plic->ready_prio[addrid] &
+                     ~((2u << plic->target_priority[addrid]) - 1);
+    uint32_t *ready;
+    int i;
+
+    if (!prios) {
+        return 0;
+    }
+
+    /* Highest priority wins, ties go to the lowest source ID */
+    ready = sifive_plic_ready(plic, addrid, 31 - clz32(prios));
+    for (i = 0; i < plic->bitfield_words; i++) {
+        if (ready[i]) {
+            return (i << 5) + ctz32(ready[i]);
+        }
+    }
+
+    g_assert_not_reached();
+}
+
+/*
+ * Drive the external interrupt lines from the current state.  Must be
+ * called with both the BQL and plic->lock held, so that the levels are
+ * published in the same order as the state changes that produced them.
+ */
 static void sifive_plic_update(SiFivePLICState *plic)
 {
     int addrid;
@@ -113,6 +207,7 @@ static void sifive_plic_update(SiFivePLICState *plic)
         PLICMode mode = plic->addr_config[addrid].mode;
         bool level = !!sifive_plic_claimed(plic, addrid);
 
+        plic->context_level[addrid] = level;
         switch (mode) {
         case PLICMode_M:
             qemu_set_irq(plic->m_external_irqs[hartid - plic->hartid_base], level);
@@ -126,6 +221,45 @@ static void sifive_plic_update(SiFivePLICState *plic)
     }
 }
 
+/* Called with plic->lock held: do any interrupt lines need to change? */
+static bool sifive_plic_update_needed(SiFivePLICState *plic)
+{
+    int addrid;
+
+    for (addrid = 0; addrid < plic->num_addrs; addrid++) {
+        if (!!sifive_plic_claimed(plic, addrid) !=
+            plic->context_level[addrid]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Context registers are accessed without the BQL.  Take it only if
+ * claim/complete/threshold changed the level of an interrupt line, and
+ * then in the same BQL -> plic->lock order as everybody else.
+ */
+static void sifive_plic_context_update(SiFivePLICState *plic, bool needed)
+{
+    bool locked = false;
+
+    if (!needed) {
+        return;
+    }
+
+    if (!qemu_mutex_iothread_locked()) {
+        locked = true;
+        qemu_mutex_lock_iothread();
+    }
+    qemu_mutex_lock(&plic->lock);
+    sifive_plic_update(plic);
+    qemu_mutex_unlock(&plic->lock);
+    if (locked) {
+        qemu_mutex_unlock_iothread();
+    }
+}
+
 static uint64_t sifive_plic_read(void *opaque, hwaddr addr, unsigned size)
 {
     SiFivePLICState *plic = opaque;
@@ -137,7 +271,7 @@ static uint64_t sifive_plic_read(void *opaque, hwaddr addr, unsigned size)
     } else if (addr_between(addr, plic->pending_base, plic->num_sources >> 3)) {
         uint32_t word = (addr - plic->pending_base) >> 2;
 
-        return plic->pending[word];
+        return qatomic_read(&plic->pending[word]);
     } else if (addr_between(addr, plic->enable_base,
                             plic->num_addrs * plic->enable_stride)) {
         uint32_t addrid = (addr - plic->enable_base) / plic->enable_stride;
@@ -146,24 +280,6 @@ static uint64_t sifive_plic_read(void *opaque, hwaddr addr, unsigned size)
         if (wordid < plic->bitfield_words) {
             return plic->enable[addrid * plic->bitfield_words + wordid];
         }
-    } else if (addr_between(addr, plic->context_base,
-                            plic->num_addrs * plic->context_stride)) {
-        uint32_t addrid = (addr - plic->context_base) / plic->context_stride;
-        uint32_t contextid = (addr & (plic->context_stride - 1));
-
-        if (contextid == 0) {
-            return plic->target_priority[addrid];
-        } else if (contextid == 4) {
-            uint32_t max_irq = sifive_plic_claimed(plic, addrid);
-
-            if (max_irq) {
-                sifive_plic_set_pending(plic, max_irq, false);
-                sifive_plic_set_claimed(plic, max_irq, true);
-            }
-
-            sifive_plic_update(plic);
-            return max_irq;
-        }
     }
 
     qemu_log_mask(LOG_GUEST_ERROR,
@@ -180,8 +296,12 @@ static void sifive_plic_write(void *opaque, hwaddr addr, uint64_t value,
     if (addr_between(addr, plic->priority_base, plic->num_sources << 2)) {
         uint32_t irq = ((addr - plic->priority_base) >> 2) + 1;
 
-        plic->source_priority[irq] = value & 7;
+        qemu_mutex_lock(&plic->lock);
+        sifive_plic_ready_del(plic, irq);
+        plic->source_priority[irq] = value & SIFIVE_PLIC_MAX_PRIORITY;
+        sifive_plic_ready_add(plic, irq);
         sifive_plic_update(plic);
+        qemu_mutex_unlock(&plic->lock);
     } else if (addr_between(addr, plic->pending_base,
                             plic->num_sources >> 3)) {
         qemu_log_mask(LOG_GUEST_ERROR,
@@ -193,32 +313,16 @@ static void sifive_plic_write(void *opaque, hwaddr addr, uint64_t value,
         uint32_t wordid = (addr & (plic->enable_stride - 1)) >> 2;
 
         if (wordid < plic->bitfield_words) {
+            qemu_mutex_lock(&plic->lock);
             plic->enable[addrid * plic->bitfield_words + wordid] = value;
+            sifive_plic_ready_rebuild(plic, addrid);
+            sifive_plic_update(plic);
+            qemu_mutex_unlock(&plic->lock);
         } else {
             qemu_log_mask(LOG_GUEST_ERROR,
                           "%s: Invalid enable write 0x%" HWADDR_PRIx "\n",
                           __func__, addr);
         }
-    } else if (addr_between(addr, plic->context_base,
-                            plic->num_addrs * plic->context_stride)) {
-        uint32_t addrid = (addr - plic->context_base) / plic->context_stride;
-        uint32_t contextid = (addr & (plic->context_stride - 1));
-
-        if (contextid == 0) {
-            if (value <= plic->num_priorities) {
-                plic->target_priority[addrid] = value;
-                sifive_plic_update(plic);
-            }
-        } else if (contextid == 4) {
-            if (value < plic->num_sources) {
-                sifive_plic_set_claimed(plic, value, false);
-                sifive_plic_update(plic);
-            }
-        } else {
-            qemu_log_mask(LOG_GUEST_ERROR,
-                          "%s: Invalid context write 0x%" HWADDR_PRIx "\n",
-                          __func__, addr);
-        }
     } else {
         qemu_log_mask(LOG_GUEST_ERROR,
                       "%s: Invalid register write 0x%" HWADDR_PRIx "\n",
@@ -236,16 +340,96 @@ static const MemoryRegionOps sifive_plic_ops = {
     }
 };
 
+static uint64_t sifive_plic_context_read(void *opaque, hwaddr addr,
+                                         unsigned size)
+{
+    SiFivePLICState *plic = opaque;
+    uint32_t addrid = addr / plic->context_stride;
+    uint32_t contextid = (addr & (plic->context_stride - 1));
+    uint32_t max_irq;
+    bool needed;
+
+    if (contextid == 0) {
+        return qatomic_read(&plic->target_priority[addrid]);
+    } else if (contextid != 4) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: Invalid register read 0x%" HWADDR_PRIx "\n",
+                      __func__, plic->context_base + addr);
+        return 0;
+    }
+
+    qemu_mutex_lock(&plic->lock);
+    max_irq = sifive_plic_claimed(plic, addrid);
+    if (max_irq) {
+        sifive_plic_set_pending(plic, max_irq, false);
+        sifive_plic_set_claimed(plic, max_irq, true);
+    }
+    needed = sifive_plic_update_needed(plic);
+    qemu_mutex_unlock(&plic->lock);
+
+    sifive_plic_context_update(plic, needed);
+    return max_irq;
+}
+
+static void sifive_plic_context_write(void *opaque, hwaddr addr,
+                                      uint64_t value, unsigned size)
+{
+    SiFivePLICState *plic = opaque;
+    uint32_t addrid = addr / plic->context_stride;
+    uint32_t contextid = (addr & (plic->context_stride - 1));
+    bool needed;
+
+    if (contextid == 0) {
+        if (value > plic->num_priorities) {
+            return;
+        }
+        qemu_mutex_lock(&plic->lock);
+        qatomic_set(&plic->target_priority[addrid], value);
+    } else if (contextid == 4) {
+        if (value >= plic->num_sources) {
+            return;
+        }
+        qemu_mutex_lock(&plic->lock);
+        sifive_plic_set_claimed(plic, value, false);
+    } else {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: Invalid context write 0x%" HWADDR_PRIx "\n",
+                      __func__, plic->context_base + addr);
+        return;
+    }
+    needed = sifive_plic_update_needed(plic);
+    qemu_mutex_unlock(&plic->lock);
+
+    sifive_plic_context_update(plic, needed);
+}
+
+/* Threshold and claim/complete registers, accessed without the BQL */
+static const MemoryRegionOps sifive_plic_context_ops = {
+    .read = sifive_plic_context_read,
+    .write = sifive_plic_context_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid = {
+        .min_access_size = 4,
+        .max_access_size = 4
+    }
+};
+
 static void sifive_plic_reset(DeviceState *dev)
 {
     SiFivePLICState *s = SIFIVE_PLIC(dev);
     int i;
 
+    qemu_mutex_lock(&s->lock);
     memset(s->source_priority, 0, sizeof(uint32_t) * s->num_sources);
     memset(s->target_priority, 0, sizeof(uint32_t) * s->num_addrs);
     memset(s->pending, 0, sizeof(uint32_t) * s->bitfield_words);
     memset(s->claimed, 0, sizeof(uint32_t) * s->bitfield_words);
     memset(s->enable, 0, sizeof(uint32_t) * s->num_enables);
+    memset(s->context_level, 0, sizeof(bool) * s->num_addrs);
+    for (i = 0; i < s->num_addrs; i++) {
+        sifive_plic_ready_rebuild(s, i);
+    }
+    qemu_mutex_unlock(&s->lock);
 
     for (i = 0; i < s->num_harts; i++) {
         qemu_set_irq(s->m_external_irqs[i], 0);
@@ -312,8 +496,10 @@ static void sifive_plic_irq_request(void *opaque, int irq, int level)
 {
     SiFivePLICState *s = opaque;
 
+    qemu_mutex_lock(&s->lock);
     sifive_plic_set_pending(s, irq, level > 0);
     sifive_plic_update(s);
+    qemu_mutex_unlock(&s->lock);
 }
 
 static void sifive_plic_realize(DeviceState *dev, Error **errp)
@@ -321,11 +507,24 @@ static void sifive_plic_realize(DeviceState *dev, Error **errp)
     SiFivePLICState *s = SIFIVE_PLIC(dev);
     int i;
 
+    qemu_mutex_init(&s->lock);
+
+    parse_hart_config(s);
+
     memory_region_init_io(&s->mmio, OBJECT(dev), &sifive_plic_ops, s,
                           TYPE_SIFIVE_PLIC, s->aperture_size);
     sysbus_init_mmio(SYS_BUS_DEVICE(dev), &s->mmio);
 
-    parse_hart_config(s);
+    /*
+     * Interrupt handlers on every hart hit the claim/complete registers,
+     * keep them off the BQL.  All state is protected by s->lock.
+     */
+    memory_region_init_io(&s->mmio_context, OBJECT(dev),
+                          &sifive_plic_context_ops, s,
+                          TYPE_SIFIVE_PLIC "-context",
+                          s->num_addrs * s->context_stride);
+    memory_region_clear_global_locking(&s->mmio_context);
+    memory_region_add_subregion(&s->mmio, s->context_base, &s->mmio_context);
 
     s->bitfield_words = (s->num_sources + 31) >> 5;
     s->num_enables = s->bitfield_words * s->num_addrs;
@@ -334,6 +533,10 @@ static void sifive_plic_realize(DeviceState *dev, Error **errp)
     s->pending = g_new0(uint32_t, s->bitfield_words);
     s->claimed = g_new0(uint32_t, s->bitfield_words);
     s->enable = g_new0(uint32_t, s->num_enables);
+    s->ready = g_new0(uint32_t, s->num_addrs * (SIFIVE_PLIC_MAX_PRIORITY + 1) *
+                                s->bitfield_words);
+    s->ready_prio = g_new0(uint32_t, s->num_addrs);
+    s->context_level = g_new0(bool, s->num_addrs);
 
     qdev_init_gpio_in(dev, sifive_plic_irq_request, s->num_sources);
 
@@ -359,10 +562,26 @@ static void sifive_plic_realize(DeviceState *dev, Error **errp)
     msi_nonbroken = true;
 }
 
+static int sifive_plic_post_load(void *opaque, int version_id)
+{
+    SiFivePLICState *s = opaque;
+    int i;
+
+    qemu_mutex_lock(&s->lock);
+    for (i = 0; i < s->num_addrs; i++) {
+        sifive_plic_ready_rebuild(s, i);
+        /* The interrupt lines themselves are migrated in mip */
+        s->context_level[i] = !!sifive_plic_claimed(s, i);
+    }
+    qemu_mutex_unlock(&s->lock);
+    return 0;
+}
+
 static const VMStateDescription vmstate_sifive_plic = {
     .name = "riscv_sifive_plic",
     .version_id = 1,
     .minimum_version_id = 1,
+    .post_load = sifive_plic_post_load,
     .fields = (VMStateField[]) {
             VMSTATE_VARRAY_UINT32(source_priority, SiFivePLICState,
                                   num_sources, 0,
@@ -41,10 +41,12 @@
 #include "sysemu/sysemu.h"
 
 //定义内存空间,CLINT:Core Local Interruptor
+//每个socket的CLINT区域内:MSWI(0x0~0x3fff) + MTIMER(0x4000~0xbfff),与SiFive CLINT布局兼容
 static const MemMapEntry virt_memmap[] = {
     [TC_NEWMAN_MROM]    = {        0x0,      0x8000 },
     [TC_NEWMAN_SRAM]    = {     0x8000,      0x8000 },
     [TC_NEWMAN_CLINT]   = {  0X2000000,      0X10000},    
+    [TC_NEWMAN_ACLINT_SSWI] = { 0x2F00000,   0x4000 },//每个socket一个SSWI,仅aclint=on时创建
     [TC_NEWMAN_PLIC]    = {  0XC000000,      TC_NEWMAN_PLIC_SIZE(TC_NEWMAN_CPUS_MAX * 2)},//所有的core共用外设控制器
     [TC_NEWMAN_UART0]   = { 0x10000000,       0x100 },
     [TC_NEWMAN_UART1]   = { 0x10001000,       0x100 },
@@ -193,11 +195,24 @@ static void tc_newman_machine_init(MachineState *machine)
         sysbus_realize(SYS_BUS_DEVICE(&s->soc[i]), &error_abort);//实现设备，设备开始运行
 
         //创建Core Local Interruptor (CLINT) 局部中断控制器
-        riscv_aclint_mtimer_create(
+        //MSWI:机器模式软件中断,写msip[hartid]即可向对应hart发送IPI
+        riscv_aclint_swi_create(
             memmap[TC_NEWMAN_CLINT].base + i * memmap[TC_NEWMAN_CLINT].size,
-                memmap[TC_NEWMAN_CLINT].size, base_hartid, hart_count,
+                base_hartid, hart_count, false);
+        //MTIMER紧跟在MSWI之后
+        riscv_aclint_mtimer_create(
+            memmap[TC_NEWMAN_CLINT].base + i * memmap[TC_NEWMAN_CLINT].size +
+                RISCV_ACLINT_SWI_SIZE,
+                RISCV_ACLINT_DEFAULT_MTIMER_SIZE, base_hartid, hart_count,
                 RISCV_ACLINT_DEFAULT_MTIMECMP, RISCV_ACLINT_DEFAULT_MTIME,
                 RISCV_ACLINT_DEFAULT_TIMEBASE_FREQ, true);
+        //SSWI:超级模式软件中断,S模式内核可以不经过SBI直接发送IPI
+        if (s->have_aclint) {
+            riscv_aclint_swi_create(
+                memmap[TC_NEWMAN_ACLINT_SSWI].base +
+                    i * memmap[TC_NEWMAN_ACLINT_SSWI].size,
+                    base_hartid, hart_count, true);
+        }
         //Platform-Level Interrupt Controller (PLIC)配置字符串初始化
         //* Per-socket PLIC hart topology configuration string */
         plic_hart_config_len =
@@ -276,6 +291,20 @@ static void tc_newman_machine_init(MachineState *machine)
                          memmap[TC_NEWMAN_FLASH].size, system_memory);
 }
 
+static bool tc_newman_get_aclint(Object *obj, Error **errp)
+{
+    TCNEWMANState *s = TC_NEWMAN_MACHINE(obj);
+
+    return s->have_aclint;
+}
+
+static void tc_newman_set_aclint(Object *obj, bool value, Error **errp)
+{
+    TCNEWMANState *s = TC_NEWMAN_MACHINE(obj);
+
+    s->have_aclint = value;
+}
+
 static void tc_newman_machine_class_init(ObjectClass *oc, void *data)
 {
     MachineClass *mc = MACHINE_CLASS(oc);//QOM中使用宏对对象类型进行转换,MACHINE使用的是隐式转换函数OBJECT_DECLARE_TYPE，所以直接找这个定义是找不到的
@@ -289,6 +318,12 @@ static void tc_newman_machine_class_init(ObjectClass *oc, void *data)
     mc->get_default_cpu_node_id = riscv_numa_get_default_cpu_node_id;//同上
     mc->numa_mem_supported = true;//
 
+    //机器属性:-M tc-newman,aclint=on 时额外创建SSWI设备
+    object_class_property_add_bool(oc, "aclint", tc_newman_get_aclint,
+                                   tc_newman_set_aclint);
+    object_class_property_set_description(oc, "aclint",
+                                          "Set on/off to enable/disable "
+                                          "emulating ACLINT SSWI devices");
 }
 
 static void tc_newman_machine_instance_init(Object *obj)
@@ -76,8 +76,15 @@ typedef uint64_t target_ulong;
 
 #if !defined(CONFIG_USER_ONLY) && defined(CONFIG_TCG)
 
-/* use a fully associative victim tlb of 8 entries */
+/*
+ * By default use a fully associative victim tlb of 8 entries; larger
+ * victim tlbs, set with -accel tcg,vtlb-size=N, are 8-way associative.
+ */
 #define CPU_VTLB_SIZE 8
+#define CPU_VTLB_WAYS 8
+
+/* number of independently tracked large page regions per mmu_idx */
+#define CPU_TLB_LARGE_PAGES 4
 
 #if HOST_LONG_BITS == 32 && TARGET_LONG_BITS == 32
 #define CPU_TLB_ENTRY_BITS 4
@@ -150,19 +157,24 @@ typedef struct CPUIOTLBEntry {
     MemTxAttrs attrs;
 } CPUIOTLBEntry;
 
+/*
+ * A region covering one or more large pages allocated into the tlb.
+ * When any page within the region is flushed, every entry within the
+ * region must be flushed.  The region is matched if
+ * (addr & mask) == addr, and is unused if both fields are -1.
+ */
+typedef struct CPUTLBLargePage {
+    target_ulong addr;
+    target_ulong mask;
+} CPUTLBLargePage;
+
 /*
  * Data elements that are per MMU mode, minus the bits accessed by
  * the TCG fast path.
  */
 typedef struct CPUTLBDesc {
-    /*
-     * Describe a region covering all of the large pages allocated
-     * into the tlb.  When any page within this region is flushed,
-     * we must flush the entire tlb.  The region is matched if
-     * (addr & large_page_mask) == large_page_addr.
-     */
-    target_ulong large_page_addr;
-    target_ulong large_page_mask;
+    /* Regions covering all of the large pages allocated into the tlb. */
+    CPUTLBLargePage large_page[CPU_TLB_LARGE_PAGES];
     /* host time (in ns) at the beginning of the time window */
     int64_t window_begin_ns;
     /* maximum number of entries observed in the window */
@@ -170,11 +182,20 @@ typedef struct CPUTLBDesc {
     size_t n_used_entries;
     /* The next index to use in the tlb victim table.  */
     size_t vindex;
-    /* The tlb victim table, in two parts.  */
-    CPUTLBEntry vtable[CPU_VTLB_SIZE];
-    CPUIOTLBEntry viotlb[CPU_VTLB_SIZE];
+    /* The tlb victim table, in two parts, of vtlb_ways << vtlb_set_bits */
+    CPUTLBEntry *vtable;
+    CPUIOTLBEntry *viotlb;
+    unsigned vtlb_ways;
+    unsigned vtlb_set_bits;
     /* The iotlb.  */
     CPUIOTLBEntry *iotlb;
+    /*
+     * Statistics of the slow path, written by the owner thread and read
+     * atomically by the monitor.
+     */
+    size_t vtlb_hit_count;
+    size_t vtlb_miss_count;
+    size_t fill_count;
 } CPUTLBDesc;
 
 /*
@@ -208,6 +229,8 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    size_t large_flush_count;
+    size_t large_merge_count;
 } CPUTLBCommon;
 
 /*
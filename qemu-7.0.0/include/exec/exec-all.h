@@ -490,6 +490,9 @@ struct TranslationBlock {
     uint16_t size;
     uint16_t icount;
 
+    /* executions counted for tier-2 superblock formation */
+    uint32_t tier2_count;
+
     struct tb_tc tc;
 
     /* first and second physical page containing code. The lower bit
@@ -64,6 +64,9 @@ typedef enum DisasJumpType {
  * @num_insns: Number of translated instructions (including current).
  * @max_insns: Maximum number of instructions to be translated in this TB.
  * @singlestep_enabled: "Hardware" single stepping enabled.
+ * @trace: Block start PCs of the hot path when building a superblock.
+ * @trace_len: Number of entries in @trace, 0 for a normal TB.
+ * @trace_next: Index of the next @trace entry to follow.
  *
  * Architecture-agnostic disassembly context.
  */
@@ -75,6 +78,9 @@ typedef struct DisasContextBase {
     int num_insns;
     int max_insns;
     bool singlestep_enabled;
+    const target_ulong *trace;
+    int trace_len;
+    int trace_next;
 #ifdef CONFIG_USER_ONLY
     /*
      * Guest address of the last byte of the last protected page.
@@ -156,6 +162,52 @@ void translator_loop_temp_check(DisasContextBase *db);
  */
 bool translator_use_goto_tb(DisasContextBase *db, target_ulong dest);
 
+/**
+ * translator_follow
+ * @db: Disassembly context
+ * @dest: a successor of the block-ending instruction being translated
+ *
+ * Return true if the TB is a tier-2 superblock whose hot path continues
+ * at @dest.  The caller then keeps translating at @dest instead of
+ * ending the TB; any other successor must be reached through a side
+ * exit, as the goto_tb slots are left for the end of the superblock.
+ */
+bool translator_follow(DisasContextBase *db, target_ulong dest);
+
+/**
+ * translator_ras_push
+ * @db: Disassembly context
+ * @ret_pc: return address of the call being translated
+ *
+ * Push the TB cached in tb_jmp_cache for @ret_pc on the shadow return
+ * stack of the CPU, for a later translator_ras_return().
+ */
+void translator_ras_push(DisasContextBase *db, target_ulong ret_pc);
+
+/**
+ * translator_ras_pop
+ * @db: Disassembly context
+ *
+ * Drop the top of the shadow return stack without using it, for a
+ * return whose target is not looked up through translator_ras_return().
+ */
+void translator_ras_pop(DisasContextBase *db);
+
+/**
+ * translator_ras_return
+ * @db: Disassembly context
+ * @dest: global or local temp holding the return address
+ * @cs_base: cs_base the CPU will have at @dest
+ * @flags: TB flags the CPU will have at @dest
+ *
+ * End the TB with a function return.  Pop the shadow return stack and,
+ * if the popped TB matches @dest, @cs_base, @flags and the cflags of
+ * the current TB, jump straight to it; otherwise fall back to
+ * tcg_gen_lookup_and_goto_ptr().  The guest PC must already be stored.
+ */
+void translator_ras_return(DisasContextBase *db, TCGv dest,
+                           target_ulong cs_base, uint32_t flags);
+
 /*
  * Translator Load Functions
  *
@@ -90,6 +90,11 @@ static inline void set_default_nan_mode(bool val, float_status *status)
     status->default_nan_mode = val;
 }
 
+static inline void set_inexact_in_host(bool val, float_status *status)
+{
+    status->inexact_in_host = val;
+}
+
 static inline void set_snan_bit_is_one(bool val, float_status *status)
 {
     status->snan_bit_is_one = val;
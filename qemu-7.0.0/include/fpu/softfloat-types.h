@@ -187,6 +187,13 @@ typedef struct float_status {
     /* should denormalised inputs go to zero and set the input_denormal flag? */
     bool flush_inputs_to_zero;
     bool default_nan_mode;
+    /*
+     * Allow hardfloat even while float_flag_inexact is clear.  Inexact
+     * results of host FPU operations are then only recorded in the
+     * sticky inexact flag of the host (see fetestexcept), which the
+     * target must merge into float_exception_flags itself.
+     */
+    bool inexact_in_host;
     /*
      * The flags below are not used on all specializations and may
      * constant fold away (see snan_bit_is_one()/no_signalling_nans() in
@@ -34,6 +34,7 @@
 #include "qom/object.h"
 
 #define UART_FIFO_LENGTH    16      /* 16550A Fifo Length */
+#define SERIAL_TX_BUF_SIZE  4096    /* fast-tx coalescing buffer */
 
 struct SerialState {
     DeviceState parent;
@@ -78,6 +79,18 @@ struct SerialState {
 
     QEMUTimer *modem_status_poll;
     MemoryRegion io;
+
+    /* fast-tx: batch transmitted bytes into one chardev write */
+    bool fast_tx;
+    bool fast_tx_pace;              /* keep baud timing on THRE/TEMT */
+    uint8_t tx_buf[SERIAL_TX_BUF_SIZE];
+    uint32_t tx_len;
+    guint tx_watch_tag;
+    QEMUBH *tx_bh;
+    QEMUTimer *tx_pace_timer;
+    uint64_t tx_pace_ts;            /* bytes are due from here on */
+    uint64_t tx_bytes;              /* bytes written by fast-tx */
+    uint64_t tx_writes;             /* successful chardev writes of them */
 };
 typedef struct SerialState SerialState;
 
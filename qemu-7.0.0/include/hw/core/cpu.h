@@ -233,6 +233,8 @@ struct hvf_vcpu_state;
 #define TB_JMP_CACHE_BITS 12
 #define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
 
+#define TB_RAS_SIZE 16
+
 /* work queue */
 
 /* The union type allows passing of 64 bit target pointers on 32 bit
@@ -340,6 +342,8 @@ struct CPUState {
     bool unplug;
     bool crash_occurred;
     bool exit_request;
+    /* Set with exit_request when the PC profiler wants a sample */
+    bool pc_sample_pending;
     bool in_exclusive_context;
     uint32_t cflags_next_tb;
     /* updates protected by BQL */
@@ -363,6 +367,14 @@ struct CPUState {
 
     /* Accessed in parallel; all accesses must be atomic */
     TranslationBlock *tb_jmp_cache[TB_JMP_CACHE_SIZE];
+    /* TB that reached the tier-2 threshold, set from generated code */
+    TranslationBlock *tier2_hot;
+    /*
+     * Shadow return stack, pushed and popped by generated code; see
+     * translator_ras_push().  Cleared together with tb_jmp_cache.
+     */
+    TranslationBlock *tb_ras[TB_RAS_SIZE];
+    uint32_t tb_ras_top;
 
     struct GDBRegisterState *gdb_regs;
     int gdb_num_regs;
@@ -442,6 +454,11 @@ extern CPUTailQ cpus;
 
 extern __thread CPUState *current_cpu;
 
+static inline void cpu_tb_ras_clear(CPUState *cpu)
+{
+    memset(cpu->tb_ras, 0, sizeof(cpu->tb_ras));
+}
+
 static inline void cpu_tb_jmp_cache_clear(CPUState *cpu)
 {
     unsigned int i;
@@ -449,6 +466,7 @@ static inline void cpu_tb_jmp_cache_clear(CPUState *cpu)
     for (i = 0; i < TB_JMP_CACHE_SIZE; i++) {
         qatomic_set(&cpu->tb_jmp_cache[i], NULL);
     }
+    cpu_tb_ras_clear(cpu);
 }
 
 /**
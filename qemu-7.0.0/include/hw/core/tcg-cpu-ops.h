@@ -110,6 +110,19 @@ struct TCGCPUOps {
      */
     bool (*io_recompile_replay_branch)(CPUState *cpu,
                                        const TranslationBlock *tb);
+
+    /**
+     * @sample_mode: Return the name of the privilege mode the cpu runs
+     * in, for the PC profiler.  Optional.
+     */
+    const char *(*sample_mode)(CPUState *cpu);
+
+    /**
+     * @sample_frames: Walk the guest frame pointer chain for the PC
+     * profiler.  Store at most @max return addresses in @pcs, innermost
+     * first, and return how many were stored.  Optional.
+     */
+    int (*sample_frames)(CPUState *cpu, vaddr *pcs, int max);
 #else
     /**
      * record_sigsegv:
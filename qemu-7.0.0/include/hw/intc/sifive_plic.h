@@ -37,6 +37,9 @@ typedef enum PLICMode {
     PLICMode_M
 } PLICMode;
 
+/* Source priorities are 3 bits wide */
+#define SIFIVE_PLIC_MAX_PRIORITY 7
+
 typedef struct PLICAddr {
     uint32_t addrid;
     uint32_t hartid;
@@ -49,6 +52,12 @@ struct SiFivePLICState {
 
     /*< public >*/
     MemoryRegion mmio;
+    MemoryRegion mmio_context;
+    /*
+     * Protects all state below.  Taken after the BQL; the context
+     * registers are accessed with only this lock held.
+     */
+    QemuMutex lock;
     uint32_t num_addrs;
     uint32_t num_harts;
     uint32_t bitfield_words;
@@ -60,6 +69,18 @@ struct SiFivePLICState {
     uint32_t *claimed;
     uint32_t *enable;
 
+    /*
+     * Sources that are pending, not claimed and enabled for a context,
+     * kept in one bitmap per context and priority: ready[(addrid *
+     * (SIFIVE_PLIC_MAX_PRIORITY + 1) + prio) * bitfield_words + word].
+     * Bit p of ready_prio[addrid] is set if the bitmap for priority p is
+     * not empty.  Priority 0 sources never interrupt and are not tracked.
+     */
+    uint32_t *ready;
+    uint32_t *ready_prio;
+    /* Level last driven on each context's interrupt line */
+    bool *context_level;
+
     /* config */
     char *hart_config;
     uint32_t hartid_base;
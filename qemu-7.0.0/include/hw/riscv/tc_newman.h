@@ -40,6 +40,7 @@ struct TCNEWMANState {
     RISCVHartArrayState soc[TC_NEWMAN_SOCKETS_MAX];//通过实例化对象，产生实际的对象数组，作为CPU
     DeviceState *plic[TC_NEWMAN_SOCKETS_MAX];//外设中断控制器
     PFlashCFI01 *flash;
+    bool have_aclint;//是否额外创建ACLINT SSWI(超级模式软件中断)设备
 };
 
 //枚举类型，便于代码阅读，定义内存空间时使用
@@ -47,6 +48,7 @@ enum {
     TC_NEWMAN_MROM,
     TC_NEWMAN_SRAM,
     TC_NEWMAN_CLINT,
+    TC_NEWMAN_ACLINT_SSWI,
     TC_NEWMAN_PLIC,
     TC_NEWMAN_UART0,
     TC_NEWMAN_UART1,
@@ -88,9 +88,23 @@ enum plugin_dyn_cb_type {
 enum plugin_dyn_cb_subtype {
     PLUGIN_CB_REGULAR,
     PLUGIN_CB_INLINE,
+    PLUGIN_CB_REGULAR_COND,
     PLUGIN_N_CB_SUBTYPES,
 };
 
+/*
+ * Per-vCPU plugin counters.  @stride is a multiple of the cache line
+ * size, so that vCPUs do not share cache lines.  @data is reallocated,
+ * with all vCPUs stopped and the code cache flushed, when a vCPU index
+ * exceeds the allocated size.
+ */
+struct qemu_plugin_scoreboard {
+    void *data;
+    size_t element_size;
+    size_t stride;
+    QLIST_ENTRY(qemu_plugin_scoreboard) entry;
+};
+
 /*
  * A dynamic callback has an insertion point that is determined at run-time.
  * Usually the insertion point is somewhere in the code cache; think for
@@ -104,13 +118,45 @@ struct qemu_plugin_dyn_cb {
     enum qemu_plugin_mem_rw rw;
     /* fields specific to each dyn_cb type go here */
     union {
+        /* updates @userp, or @entry of the vCPU if @entry.score is set */
         struct {
             enum qemu_plugin_op op;
             uint64_t imm;
+            qemu_plugin_u64 entry;
         } inline_insn;
+        /* a regular cb, only called if "@entry @cond @imm" holds */
+        struct {
+            enum qemu_plugin_cond cond;
+            uint64_t imm;
+            qemu_plugin_u64 entry;
+        } cond;
     };
 };
 
+/*
+ * Return the counter @entry of vCPU 0, and in @stride the distance to
+ * the counter of the next vCPU.
+ */
+static inline void *plugin_u64_base(qemu_plugin_u64 entry, size_t *stride)
+{
+    *stride = entry.score->stride;
+    return (char *)entry.score->data + entry.offset;
+}
+
+/*
+ * Return the counter an inline op updates for vCPU 0, and in @stride
+ * the distance to the counter of the next vCPU.
+ */
+static inline void *plugin_inline_op_base(const struct qemu_plugin_dyn_cb *cb,
+                                          size_t *stride)
+{
+    if (!cb->inline_insn.entry.score) {
+        *stride = 0;
+        return cb->userp;
+    }
+    return plugin_u64_base(cb->inline_insn.entry, stride);
+}
+
 /* Internal context for instrumenting an instruction */
 struct qemu_plugin_insn {
     GByteArray *data;
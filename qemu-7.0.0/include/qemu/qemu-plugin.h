@@ -51,7 +51,7 @@ typedef uint64_t qemu_plugin_id_t;
 
 extern QEMU_PLUGIN_EXPORT int qemu_plugin_version;
 
-#define QEMU_PLUGIN_VERSION 1
+#define QEMU_PLUGIN_VERSION 3
 
 /**
  * struct qemu_info_t - system information for plugins
@@ -282,6 +282,30 @@ enum qemu_plugin_op {
     QEMU_PLUGIN_INLINE_ADD_U64,
 };
 
+/**
+ * struct qemu_plugin_scoreboard - per-vCPU array of plugin counters
+ *
+ * A scoreboard holds one entry of a plugin-chosen size per vCPU.  Each
+ * entry sits on its own cache lines, so inline ops can update the entry
+ * of the vCPU they run on without atomics and without bouncing cache
+ * lines between vCPUs.  Entries are zeroed on creation and the
+ * scoreboard grows as vCPUs are created.
+ */
+struct qemu_plugin_scoreboard;
+
+/**
+ * typedef qemu_plugin_u64 - a uint64_t counter in scoreboard entries
+ * @score: the scoreboard
+ * @offset: offset of the counter in each entry
+ *
+ * Build one with qemu_plugin_scoreboard_u64() or
+ * qemu_plugin_scoreboard_u64_in_struct().
+ */
+typedef struct {
+    struct qemu_plugin_scoreboard *score;
+    size_t offset;
+} qemu_plugin_u64;
+
 /**
  * qemu_plugin_register_vcpu_tb_exec_inline() - execution inline op
  * @tb: the opaque qemu_plugin_tb handle for the translation
@@ -300,6 +324,72 @@ void qemu_plugin_register_vcpu_tb_exec_inline(struct qemu_plugin_tb *tb,
                                               enum qemu_plugin_op op,
                                               void *ptr, uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu() - per-vCPU inline op
+ * @tb: the opaque qemu_plugin_tb handle for the translation
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @entry: the counter to update, in the entry of the executing vCPU
+ * @imm: the op data (e.g. 1)
+ *
+ * As qemu_plugin_register_vcpu_tb_exec_inline(), but each vCPU updates
+ * its own copy of the counter, so results are exact with MTTCG.
+ */
+void qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+    struct qemu_plugin_tb *tb,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm);
+
+/**
+ * enum qemu_plugin_cond - condition of a conditional callback
+ *
+ * @QEMU_PLUGIN_COND_NEVER: false
+ * @QEMU_PLUGIN_COND_ALWAYS: true
+ * @QEMU_PLUGIN_COND_EQ: is equal?
+ * @QEMU_PLUGIN_COND_NE: is not equal?
+ * @QEMU_PLUGIN_COND_LT: is less than?
+ * @QEMU_PLUGIN_COND_LE: is less than or equal?
+ * @QEMU_PLUGIN_COND_GT: is greater than?
+ * @QEMU_PLUGIN_COND_GE: is greater than or equal?
+ *
+ * Comparisons are unsigned.
+ */
+enum qemu_plugin_cond {
+    QEMU_PLUGIN_COND_NEVER,
+    QEMU_PLUGIN_COND_ALWAYS,
+    QEMU_PLUGIN_COND_EQ,
+    QEMU_PLUGIN_COND_NE,
+    QEMU_PLUGIN_COND_LT,
+    QEMU_PLUGIN_COND_LE,
+    QEMU_PLUGIN_COND_GT,
+    QEMU_PLUGIN_COND_GE,
+};
+
+/**
+ * qemu_plugin_register_vcpu_tb_exec_cond_cb() - conditional execution cb
+ * @tb: the opaque qemu_plugin_tb handle for the translation
+ * @cb: callback function
+ * @flags: does the plugin read or write the CPU's registers?
+ * @cond: condition on the counter
+ * @entry: counter of the executing vCPU to compare
+ * @imm: value to compare the counter with
+ * @userdata: any plugin data to pass to the @cb?
+ *
+ * The @cb function is called every time a translated unit executes and
+ * "@entry @cond @imm" holds.  The comparison is inlined, so the cost of
+ * a call is only paid when the condition holds.  Inline ops registered
+ * for the same event run first: combined with an
+ * QEMU_PLUGIN_INLINE_ADD_U64 on @entry and a callback that resets it,
+ * this calls @cb once every @imm executions.
+ */
+void qemu_plugin_register_vcpu_tb_exec_cond_cb(struct qemu_plugin_tb *tb,
+                                               qemu_plugin_vcpu_udata_cb_t cb,
+                                               enum qemu_plugin_cb_flags flags,
+                                               enum qemu_plugin_cond cond,
+                                               qemu_plugin_u64 entry,
+                                               uint64_t imm,
+                                               void *userdata);
+
 /**
  * qemu_plugin_register_vcpu_insn_exec_cb() - register insn execution cb
  * @insn: the opaque qemu_plugin_insn handle for an instruction
@@ -328,6 +418,44 @@ void qemu_plugin_register_vcpu_insn_exec_inline(struct qemu_plugin_insn *insn,
                                                 enum qemu_plugin_op op,
                                                 void *ptr, uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu() - per-vCPU inline op
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @entry: the counter to update, in the entry of the executing vCPU
+ * @imm: the op data (e.g. 1)
+ *
+ * As qemu_plugin_register_vcpu_insn_exec_inline(), but each vCPU
+ * updates its own copy of the counter.
+ */
+void qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+    struct qemu_plugin_insn *insn,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm);
+
+/**
+ * qemu_plugin_register_vcpu_insn_exec_cond_cb() - conditional insn cb
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @cb: callback function
+ * @flags: does the plugin read or write the CPU's registers?
+ * @cond: condition on the counter
+ * @entry: counter of the executing vCPU to compare
+ * @imm: value to compare the counter with
+ * @userdata: any plugin data to pass to the @cb?
+ *
+ * As qemu_plugin_register_vcpu_tb_exec_cond_cb(), for every execution
+ * of an instruction.
+ */
+void qemu_plugin_register_vcpu_insn_exec_cond_cb(
+    struct qemu_plugin_insn *insn,
+    qemu_plugin_vcpu_udata_cb_t cb,
+    enum qemu_plugin_cb_flags flags,
+    enum qemu_plugin_cond cond,
+    qemu_plugin_u64 entry,
+    uint64_t imm,
+    void *userdata);
+
 /**
  * qemu_plugin_tb_n_insns() - query helper for number of insns in TB
  * @tb: opaque handle to TB passed to callback
@@ -497,6 +625,28 @@ void qemu_plugin_register_vcpu_mem_inline(struct qemu_plugin_insn *insn,
                                           enum qemu_plugin_op op, void *ptr,
                                           uint64_t imm);
 
+void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+    struct qemu_plugin_insn *insn,
+    enum qemu_plugin_mem_rw rw,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm);
+
+/*
+ * As qemu_plugin_register_vcpu_mem_cb(), but @cb is only called when
+ * "@entry @cond @imm" holds for the vCPU doing the access; see
+ * qemu_plugin_register_vcpu_tb_exec_cond_cb().  As there, the comparison
+ * is inlined and no call is made when it does not hold.
+ */
+void qemu_plugin_register_vcpu_mem_cond_cb(struct qemu_plugin_insn *insn,
+                                           qemu_plugin_vcpu_mem_cb_t cb,
+                                           enum qemu_plugin_cb_flags flags,
+                                           enum qemu_plugin_mem_rw rw,
+                                           enum qemu_plugin_cond cond,
+                                           qemu_plugin_u64 entry,
+                                           uint64_t imm,
+                                           void *userdata);
+
 
 
 typedef void
@@ -572,6 +722,71 @@ int qemu_plugin_n_vcpus(void);
 /* returns -1 in user-mode */
 int qemu_plugin_n_max_vcpus(void);
 
+/**
+ * qemu_plugin_num_vcpus() - number of vCPUs created so far
+ *
+ * Unlike qemu_plugin_n_vcpus() this also works in user-mode, where it
+ * counts every thread that was ever started.  Scoreboard entries exist
+ * for vCPU indexes below this number.
+ */
+int qemu_plugin_num_vcpus(void);
+
+/**
+ * qemu_plugin_scoreboard_new() - allocate a new scoreboard
+ * @element_size: size of the entry of each vCPU, in bytes
+ *
+ * Returns: a zeroed scoreboard, to be freed with
+ * qemu_plugin_scoreboard_free().
+ */
+struct qemu_plugin_scoreboard *qemu_plugin_scoreboard_new(size_t element_size);
+
+/**
+ * qemu_plugin_scoreboard_free() - free a scoreboard
+ * @score: scoreboard to free
+ *
+ * Generated code may still update the scoreboard until the plugin is
+ * uninstalled, so only call this from the atexit or uninstall callbacks.
+ */
+void qemu_plugin_scoreboard_free(struct qemu_plugin_scoreboard *score);
+
+/**
+ * qemu_plugin_scoreboard_find() - entry of a vCPU in a scoreboard
+ * @score: scoreboard to query
+ * @vcpu_index: vCPU index, below qemu_plugin_num_vcpus()
+ *
+ * The pointer is valid until the next vCPU is created.
+ */
+void *qemu_plugin_scoreboard_find(struct qemu_plugin_scoreboard *score,
+                                  unsigned int vcpu_index);
+
+/* the entries of @score are a single uint64_t counter */
+#define qemu_plugin_scoreboard_u64(score) \
+    (qemu_plugin_u64) {score, 0}
+
+/* the counter is @member of the @type entries of @score */
+#define qemu_plugin_scoreboard_u64_in_struct(score, type, member) \
+    (qemu_plugin_u64) {score, offsetof(type, member)}
+
+/* add @added to the counter of @vcpu_index */
+void qemu_plugin_u64_add(qemu_plugin_u64 entry, unsigned int vcpu_index,
+                         uint64_t added);
+
+/* read the counter of @vcpu_index */
+uint64_t qemu_plugin_u64_get(qemu_plugin_u64 entry, unsigned int vcpu_index);
+
+/* set the counter of @vcpu_index */
+void qemu_plugin_u64_set(qemu_plugin_u64 entry, unsigned int vcpu_index,
+                         uint64_t val);
+
+/**
+ * qemu_plugin_u64_sum() - sum a counter over all vCPUs
+ * @entry: counter to sum
+ *
+ * Meant for the atexit callback: the counters of running vCPUs may be
+ * updated concurrently.
+ */
+uint64_t qemu_plugin_u64_sum(qemu_plugin_u64 entry);
+
 /**
  * qemu_plugin_outs() - output string via QEMU's logging system
  * @string: a string
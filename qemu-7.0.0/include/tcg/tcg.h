@@ -267,6 +267,14 @@ struct TCGLabel {
         uintptr_t value;
         const tcg_insn_unit *value_ptr;
     } u;
+    /*
+     * With tcg_carry_globals: the globals live after the label (set by
+     * liveness), and how many branches to the label were allocated so far
+     * together with the register each global held in all of them, or -1.
+     */
+    unsigned long *live_globals;
+    unsigned carry_preds;
+    int8_t *carry_regs;
     QSIMPLEQ_HEAD(, TCGRelocation) relocs;
     QSIMPLEQ_ENTRY(TCGLabel) next;
 };
@@ -281,6 +289,7 @@ typedef struct TCGPool {
 
 #define TCG_MAX_TEMPS 512
 #define TCG_MAX_INSNS 512
+#define TCG_TIER2_MAX_BLOCKS 8
 
 /* when the size of the arguments of a called function is smaller than
    this value, they are statically allocated in the TB stack frame */
@@ -535,6 +544,22 @@ typedef struct TCGProfile {
     int64_t table_op_count[NB_OPS];
 } TCGProfile;
 
+/* What the last tcg_optimize() did, reported with -d op_opt */
+typedef struct TCGOptStats {
+    int ld_forwarded;   /* env loads replaced by a known value */
+    int st_dead;        /* env stores overwritten before being read */
+    int cse;            /* pure ops replaced by an earlier result */
+    int qemu_ld_cse;    /* guest loads replaced by an earlier load */
+} TCGOptStats;
+
+/* Register allocator counters, summed over all contexts for "info jit" */
+typedef struct TCGRegAllocStats {
+    size_t tbs;             /* TBs allocated */
+    size_t global_loads;    /* globals loaded from env */
+    size_t global_stores;   /* globals stored back to env */
+    size_t label_carries;   /* globals kept in a register across a label */
+} TCGRegAllocStats;
+
 struct TCGContext {
     uint8_t *pool_cur, *pool_end;
     TCGPool *pool_first, *pool_current, *pool_first_large;
@@ -543,6 +568,8 @@ struct TCGContext {
     int nb_temps;
     int nb_indirects;
     int nb_ops;
+    TCGOptStats opt_stats;
+    TCGRegAllocStats ra_stats;
 
     /* goto_tb support */
     tcg_insn_unit *code_buf;
@@ -622,6 +649,10 @@ struct TCGContext {
     uint16_t gen_insn_end_off[TCG_MAX_INSNS];
     target_ulong gen_insn_data[TCG_MAX_INSNS][TARGET_INSN_START_WORDS];
 
+    /* Block start PCs along a hot path, see tb_tier2_compile() */
+    target_ulong tier2_trace[TCG_TIER2_MAX_BLOCKS];
+    int tier2_trace_len;
+
     /* Exit to translator on overflow. */
     sigjmp_buf jmp_trans;
 };
@@ -635,6 +666,7 @@ extern __thread TCGContext *tcg_ctx;
 extern const void *tcg_code_gen_epilogue;
 extern uintptr_t tcg_splitwx_diff;
 extern TCGv_env cpu_env;
+extern bool tcg_carry_globals;
 
 bool in_code_gen_buffer(const void *p);
 
@@ -806,6 +838,8 @@ void tcg_pool_reset(TCGContext *s);
 TranslationBlock *tcg_tb_alloc(TCGContext *s);
 
 void tcg_region_reset_all(void);
+bool tcg_region_available(void);
+size_t tcg_region_evict(void (*evict)(TranslationBlock *tb));
 
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
@@ -944,6 +978,7 @@ int tcg_check_temp_count(void);
 int64_t tcg_cpu_exec_time(void);
 void tcg_dump_info(GString *buf);
 void tcg_dump_op_count(GString *buf);
+void tcg_regalloc_stats(TCGRegAllocStats *stats);
 
 #define TCG_CT_CONST  1 /* any constant of register size */
 
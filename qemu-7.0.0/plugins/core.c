@@ -16,6 +16,7 @@
 #include "qemu/config-file.h"
 #include "qapi/error.h"
 #include "qemu/lockable.h"
+#include "qemu/memalign.h"
 #include "qemu/option.h"
 #include "qemu/rcu_queue.h"
 #include "qemu/xxhash.h"
@@ -210,11 +211,123 @@ plugin_register_cb_udata(qemu_plugin_id_t id, enum qemu_plugin_event ev,
     do_plugin_register_cb(id, ev, func, udata);
 }
 
+/* Scoreboard entries are aligned to this, so vCPUs never share a line */
+#define SCOREBOARD_ALIGN 64
+
+static void *plugin_scoreboard_alloc(struct qemu_plugin_scoreboard *score,
+                                     size_t n_vcpus)
+{
+    void *data = qemu_memalign(SCOREBOARD_ALIGN, score->stride * n_vcpus);
+
+    memset(data, 0, score->stride * n_vcpus);
+    return data;
+}
+
+struct qemu_plugin_scoreboard *plugin_scoreboard_new(size_t element_size)
+{
+    struct qemu_plugin_scoreboard *score;
+
+    score = g_new0(struct qemu_plugin_scoreboard, 1);
+    score->element_size = element_size;
+    score->stride = QEMU_ALIGN_UP(MAX(element_size, 1), SCOREBOARD_ALIGN);
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    score->data = plugin_scoreboard_alloc(score, plugin.scoreboard_alloc_size);
+    QLIST_INSERT_HEAD(&plugin.scoreboards, score, entry);
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    return score;
+}
+
+void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score)
+{
+    qemu_rec_mutex_lock(&plugin.lock);
+    QLIST_REMOVE(score, entry);
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    qemu_vfree(score->data);
+    g_free(score);
+}
+
+/*
+ * Size scoreboards for @n_vcpus before any vCPU runs.  In system mode
+ * this covers all the vCPUs that can ever be hotplugged, so growing
+ * only happens in user mode, from the thread creating a new vCPU.
+ */
+void plugin_scoreboard_reserve(size_t n_vcpus)
+{
+    qemu_rec_mutex_lock(&plugin.lock);
+    if (n_vcpus > plugin.scoreboard_alloc_size) {
+        struct qemu_plugin_scoreboard *score;
+
+        QLIST_FOREACH(score, &plugin.scoreboards, entry) {
+            qemu_vfree(score->data);
+            score->data = plugin_scoreboard_alloc(score, n_vcpus);
+        }
+        plugin.scoreboard_alloc_size = n_vcpus;
+    }
+    qemu_rec_mutex_unlock(&plugin.lock);
+}
+
+static void plugin_grow_scoreboards__locked(CPUState *cpu)
+{
+    struct qemu_plugin_scoreboard *score;
+    size_t size = plugin.scoreboard_alloc_size;
+
+    if (cpu->cpu_index < size) {
+        return;
+    }
+    while (cpu->cpu_index >= size) {
+        size *= 2;
+    }
+    if (QLIST_EMPTY(&plugin.scoreboards)) {
+        plugin.scoreboard_alloc_size = size;
+        return;
+    }
+
+    /*
+     * Generated code embeds the address of the scoreboards: stop the
+     * other vCPUs, move the scoreboards and flush the code cache.
+     */
+    qemu_rec_mutex_unlock(&plugin.lock);
+    if (current_cpu) {
+        start_exclusive();
+    }
+    qemu_rec_mutex_lock(&plugin.lock);
+
+    /* another vCPU may have grown them in between */
+    if (size > plugin.scoreboard_alloc_size) {
+        QLIST_FOREACH(score, &plugin.scoreboards, entry) {
+            void *data = plugin_scoreboard_alloc(score, size);
+
+            memcpy(data, score->data,
+                   score->stride * plugin.scoreboard_alloc_size);
+            qemu_vfree(score->data);
+            score->data = data;
+        }
+        plugin.scoreboard_alloc_size = size;
+        if (current_cpu) {
+            tb_flush(current_cpu);
+        }
+    }
+
+    if (current_cpu) {
+        end_exclusive();
+    }
+}
+
+int plugin_num_vcpus(void)
+{
+    return qatomic_read(&plugin.num_vcpus);
+}
+
 void qemu_plugin_vcpu_init_hook(CPUState *cpu)
 {
     bool success;
 
     qemu_rec_mutex_lock(&plugin.lock);
+    plugin_grow_scoreboards__locked(cpu);
+    qatomic_set(&plugin.num_vcpus, MAX(plugin.num_vcpus, cpu->cpu_index + 1));
     plugin_cpu_update__locked(&cpu->cpu_index, NULL, NULL);
     success = g_hash_table_insert(plugin.cpu_ht, &cpu->cpu_index,
                                   &cpu->cpu_index);
@@ -292,6 +405,24 @@ void plugin_register_inline_op(GArray **arr,
     dyn_cb->rw = rw;
     dyn_cb->inline_insn.op = op;
     dyn_cb->inline_insn.imm = imm;
+    dyn_cb->inline_insn.entry.score = NULL;
+    dyn_cb->inline_insn.entry.offset = 0;
+}
+
+void plugin_register_inline_op_per_vcpu(GArray **arr,
+                                        enum qemu_plugin_mem_rw rw,
+                                        enum qemu_plugin_op op,
+                                        qemu_plugin_u64 entry,
+                                        uint64_t imm)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb;
+
+    g_assert(entry.score &&
+             entry.offset + sizeof(uint64_t) <= entry.score->element_size);
+
+    plugin_register_inline_op(arr, rw, op, NULL, imm);
+    dyn_cb = &g_array_index(*arr, struct qemu_plugin_dyn_cb, (*arr)->len - 1);
+    dyn_cb->inline_insn.entry = entry;
 }
 
 void plugin_register_dyn_cb__udata(GArray **arr,
@@ -323,6 +454,80 @@ void plugin_register_vcpu_mem_cb(GArray **arr,
     dyn_cb->f.generic = cb;
 }
 
+static void plugin_set_cond(struct qemu_plugin_dyn_cb *dyn_cb,
+                            enum qemu_plugin_cond cond,
+                            qemu_plugin_u64 entry, uint64_t imm)
+{
+    g_assert(entry.score &&
+             entry.offset + sizeof(uint64_t) <= entry.score->element_size);
+    g_assert(cond != QEMU_PLUGIN_COND_NEVER &&
+             cond != QEMU_PLUGIN_COND_ALWAYS);
+
+    dyn_cb->type = PLUGIN_CB_REGULAR_COND;
+    dyn_cb->cond.cond = cond;
+    dyn_cb->cond.entry = entry;
+    dyn_cb->cond.imm = imm;
+}
+
+void plugin_register_dyn_cond_cb__udata(GArray **arr,
+                                        qemu_plugin_vcpu_udata_cb_t cb,
+                                        enum qemu_plugin_cb_flags flags,
+                                        enum qemu_plugin_cond cond,
+                                        qemu_plugin_u64 entry,
+                                        uint64_t imm,
+                                        void *udata)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb = plugin_get_dyn_cb(arr);
+
+    dyn_cb->userp = udata;
+    /* Note flags are discarded as unused. */
+    dyn_cb->f.vcpu_udata = cb;
+    plugin_set_cond(dyn_cb, cond, entry, imm);
+}
+
+void plugin_register_vcpu_mem_cond_cb(GArray **arr,
+                                      void *cb,
+                                      enum qemu_plugin_cb_flags flags,
+                                      enum qemu_plugin_mem_rw rw,
+                                      enum qemu_plugin_cond cond,
+                                      qemu_plugin_u64 entry,
+                                      uint64_t imm,
+                                      void *udata)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb = plugin_get_dyn_cb(arr);
+
+    dyn_cb->userp = udata;
+    /* Note flags are discarded as unused. */
+    dyn_cb->rw = rw;
+    dyn_cb->f.generic = cb;
+    plugin_set_cond(dyn_cb, cond, entry, imm);
+}
+
+static bool plugin_cond_holds(struct qemu_plugin_dyn_cb *cb, int cpu_index)
+{
+    size_t stride;
+    char *base = plugin_u64_base(cb->cond.entry, &stride);
+    uint64_t val = *(uint64_t *)(base + cpu_index * stride);
+    uint64_t imm = cb->cond.imm;
+
+    switch (cb->cond.cond) {
+    case QEMU_PLUGIN_COND_EQ:
+        return val == imm;
+    case QEMU_PLUGIN_COND_NE:
+        return val != imm;
+    case QEMU_PLUGIN_COND_LT:
+        return val < imm;
+    case QEMU_PLUGIN_COND_LE:
+        return val <= imm;
+    case QEMU_PLUGIN_COND_GT:
+        return val > imm;
+    case QEMU_PLUGIN_COND_GE:
+        return val >= imm;
+    default:
+        g_assert_not_reached();
+    }
+}
+
 /*
  * Disable CFI checks.
  * The callback function has been loaded from an external library so we do not
@@ -432,9 +637,11 @@ void qemu_plugin_flush_cb(void)
     plugin_cb__simple(QEMU_PLUGIN_EV_FLUSH);
 }
 
-void exec_inline_op(struct qemu_plugin_dyn_cb *cb)
+void exec_inline_op(struct qemu_plugin_dyn_cb *cb, int cpu_index)
 {
-    uint64_t *val = cb->userp;
+    size_t stride;
+    char *base = plugin_inline_op_base(cb, &stride);
+    uint64_t *val = (uint64_t *)(base + cpu_index * stride);
 
     switch (cb->inline_insn.op) {
     case QEMU_PLUGIN_INLINE_ADD_U64:
@@ -467,7 +674,13 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                            vaddr, cb->userp);
             break;
         case PLUGIN_CB_INLINE:
-            exec_inline_op(cb);
+            exec_inline_op(cb, cpu->cpu_index);
+            break;
+        case PLUGIN_CB_REGULAR_COND:
+            if (plugin_cond_holds(cb, cpu->cpu_index)) {
+                cb->f.vcpu_mem(cpu->cpu_index, make_plugin_meminfo(oi, rw),
+                               vaddr, cb->userp);
+            }
             break;
         default:
             g_assert_not_reached();
@@ -552,6 +765,8 @@ static void __attribute__((__constructor__)) plugin_init(void)
     plugin.id_ht = g_hash_table_new(g_int64_hash, g_int64_equal);
     plugin.cpu_ht = g_hash_table_new(g_int_hash, g_int_equal);
     QTAILQ_INIT(&plugin.ctxs);
+    QLIST_INIT(&plugin.scoreboards);
+    plugin.scoreboard_alloc_size = 16;
     qht_init(&plugin.dyn_cb_arr_ht, plugin_dyn_cb_arr_cmp, 16,
              QHT_MODE_AUTO_RESIZE);
     atexit(qemu_plugin_atexit_cb);
@@ -184,6 +184,11 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
+    "                tier2=on|off (retranslate hot TCG paths as superblocks)\n"
+    "                tier2-threshold=n (executions before a TB becomes hot)\n"
+    "                vtlb-size=n (entries of the TCG victim TLB, default 8)\n"
+    "                vtlb-ways=n (associativity of the TCG victim TLB, default 8)\n"
+    "                carry-globals=on|off (keep TCG globals in registers across labels)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
     "                thread=single|multi (enable multi-threaded TCG)\n", QEMU_ARCH_ALL)
 SRST
@@ -218,6 +223,33 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``tier2=on|off``
+        Counts executions of each translation block and, once a block has
+        run ``tier2-threshold`` times (default 1000), retranslates it
+        together with its hot forward successors in the same page as a
+        single superblock, leaving the colder paths through side exits.
+        Currently only the RISC-V front end forms superblocks; on other
+        targets this only adds the counting overhead.  Not available with
+        icount.
+
+    ``vtlb-size=n``
+        Sets the number of entries, a power of 2 up to 4096, of the victim
+        TLB that backs the software TLB of each MMU mode (default 8).
+        Larger victim TLBs help guests whose working set conflicts in the
+        main TLB.
+
+    ``vtlb-ways=n``
+        Sets the associativity of the victim TLB (default 8).  A victim TLB
+        of at most ``n`` entries is fully associative.  Hits, misses and
+        TLB fills per MMU mode are shown by ``info vtlb``.
+
+    ``carry-globals=on|off``
+        Lets the TCG register allocator keep guest registers in host
+        registers across branch targets inside a translation block when
+        all branches to the target agree on the host register, instead of
+        reloading them from memory.  Defaults to off.  ``info jit``
+        reports the average global loads and stores per translation block.
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefore taking advantage of
@@ -26,7 +26,15 @@
  *  - U mode HLV/HLVX/HSV 0b100
  *  - S mode HLV/HLVX/HSV 0b101
  *  - M mode HLV/HLVX/HSV 0b111
+ *
+ * With the x-asid-tlb property, U and S mode translations of further
+ * address spaces stay resident in their own MMU indexes:
+ *  - U mode ASID slot N 0b1000 + 2 * (N - 1)
+ *  - S mode ASID slot N 0b1001 + 2 * (N - 1)
+ * Slot 0 is the plain U/S index above.
  */
-#define NB_MMU_MODES 8
+#define NB_MMU_MODES 16
+#define RISCV_ASID_MMU_IDX_BASE 8
+#define RISCV_TLB_ASID_SLOTS 5
 
 #endif
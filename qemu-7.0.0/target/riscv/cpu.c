@@ -480,12 +480,19 @@ static void riscv_cpu_reset(DeviceState *dev)
     }
     /* mmte is supposed to have pm.current hardwired to 1 */
     env->mmte |= (PM_EXT_INITIAL | MMTE_M_PM_CURRENT);
+
+    /* The TLB was flushed by the parent reset, forget the ASID slots */
+    env->asid_slot = 0;
+    env->asid_slot_valid = 0;
+    memset(env->asid_slot_stamp, 0, sizeof(env->asid_slot_stamp));
+    riscv_cpu_pwc_flush(env);
 #endif
     env->xl = riscv_cpu_mxl(env);
     riscv_cpu_update_mask(env);
     cs->exception_index = RISCV_EXCP_NONE;
     env->load_res = -1;
     set_default_nan_mode(1, &env->fp_status);
+    set_inexact_in_host(true, &env->fp_status);
 
 #ifndef CONFIG_USER_ONLY
     if (riscv_feature(env, RISCV_FEATURE_DEBUG)) {
@@ -955,6 +962,8 @@ static Property riscv_cpu_properties[] = {
     DEFINE_PROP_BOOL("short-isa-string", RISCVCPU, cfg.short_isa_string, false),
 
     DEFINE_PROP_BOOL("rvv_ta_all_1s", RISCVCPU, cfg.rvv_ta_all_1s, false),
+
+    DEFINE_PROP_BOOL("x-asid-tlb", RISCVCPU, cfg.asid_tlb, false),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -1000,9 +1009,110 @@ static const struct SysemuCPUOps riscv_sysemu_ops = {
 
 #include "hw/core/tcg-cpu-ops.h"
 
+static void riscv_cpu_exec_enter(CPUState *cs)
+{
+    /* Drop host inexact state left by anything but guest FP operations */
+    riscv_cpu_clear_host_fflags();
+}
+
+static void riscv_cpu_exec_exit(CPUState *cs)
+{
+    riscv_cpu_sync_fflags(&RISCV_CPU(cs)->env);
+}
+
+#ifndef CONFIG_USER_ONLY
+static const char *riscv_cpu_sample_mode(CPUState *cs)
+{
+    CPURISCVState *env = &RISCV_CPU(cs)->env;
+
+    switch (env->priv) {
+    case PRV_U:
+        return riscv_cpu_virt_enabled(env) ? "VU" : "U";
+    case PRV_S:
+        return riscv_cpu_virt_enabled(env) ? "VS" : "S";
+    default:
+        return "M";
+    }
+}
+
+/*
+ * Read a frame record for the profiler.  s0 is whatever the guest left
+ * there, so only read records that lie in one page backed by RAM: this
+ * must never touch MMIO.
+ */
+static bool riscv_cpu_read_frame(CPUState *cs, vaddr addr, void *buf,
+                                 hwaddr len)
+{
+    MemTxAttrs attrs;
+    MemoryRegion *mr;
+    AddressSpace *as;
+    hwaddr phys, xlat, l = len;
+
+    if ((addr ^ (addr + len - 1)) & TARGET_PAGE_MASK) {
+        return false;
+    }
+    phys = cpu_get_phys_page_attrs_debug(cs, addr & TARGET_PAGE_MASK, &attrs);
+    if (phys == -1) {
+        return false;
+    }
+    phys += addr & ~TARGET_PAGE_MASK;
+    as = cpu_get_address_space(cs, cpu_asidx_from_attrs(cs, attrs));
+
+    RCU_READ_LOCK_GUARD();
+    mr = address_space_translate(as, phys, &xlat, &l, false, attrs);
+    if (l < len || !memory_region_is_ram(mr) ||
+        memory_region_is_ram_device(mr)) {
+        return false;
+    }
+    return address_space_read(as, phys, attrs, buf, len) == MEMTX_OK;
+}
+
+/*
+ * With frame pointers, s0 points just above the frame record of the
+ * current function: the return address, and below it the caller's s0.
+ * Functions that save no return address are not seen.
+ */
+static int riscv_cpu_sample_frames(CPUState *cs, vaddr *pcs, int max)
+{
+    CPURISCVState *env = &RISCV_CPU(cs)->env;
+    int xlen_bytes = riscv_cpu_mxl_bits(env) / 8;
+    target_ulong fp = env->gpr[8];
+    uint8_t rec[16];
+    int n = 0;
+
+    while (n < max && fp && !(fp & (xlen_bytes - 1))) {
+        target_ulong prev_fp, ra;
+
+        if (!riscv_cpu_read_frame(cs, fp - 2 * xlen_bytes, rec,
+                                  2 * xlen_bytes)) {
+            break;
+        }
+        if (xlen_bytes == 4) {
+            prev_fp = ldl_le_p(rec);
+            ra = ldl_le_p(rec + 4);
+        } else {
+            prev_fp = ldq_le_p(rec);
+            ra = ldq_le_p(rec + 8);
+        }
+        if (!ra) {
+            break;
+        }
+        pcs[n++] = ra;
+        /* The stack grows down: stop on anything else */
+        if (prev_fp <= fp) {
+            break;
+        }
+        fp = prev_fp;
+    }
+    return n;
+}
+#endif /* !CONFIG_USER_ONLY */
+
 static const struct TCGCPUOps riscv_tcg_ops = {
     .initialize = riscv_translate_init,
     .synchronize_from_tb = riscv_cpu_synchronize_from_tb,
+    .cpu_exec_enter = riscv_cpu_exec_enter,
+    .cpu_exec_exit = riscv_cpu_exec_exit,
 
 #ifndef CONFIG_USER_ONLY
     .tlb_fill = riscv_cpu_tlb_fill,
@@ -1013,6 +1123,8 @@ static const struct TCGCPUOps riscv_tcg_ops = {
     .debug_excp_handler = riscv_cpu_debug_excp_handler,
     .debug_check_breakpoint = riscv_cpu_debug_check_breakpoint,
     .debug_check_watchpoint = riscv_cpu_debug_check_watchpoint,
+    .sample_mode = riscv_cpu_sample_mode,
+    .sample_frames = riscv_cpu_sample_frames,
 #endif /* !CONFIG_USER_ONLY */
 };
 
@@ -118,6 +118,21 @@ typedef struct CPUArchState CPURISCVState;
 
 #define RV_VLEN_MAX 1024
 
+/*
+ * Page-walk cache: remembers the physical address of the last-level page
+ * table for a satp and a virtual address range, so that a TLB miss only
+ * needs to load the leaf PTE.  Invalidated by sfence.vma, satp writes and
+ * PMP changes.
+ */
+#define RISCV_PWC_ENTRIES 32
+
+typedef struct RISCVPWCEntry {
+    target_ulong satp;
+    target_ulong vpn;       /* addr >> (PGSHIFT + ptidxbits) */
+    hwaddr base;            /* physical address of the leaf page table */
+    bool valid;
+} RISCVPWCEntry;
+
 FIELD(VTYPE, VLMUL, 0, 3)
 FIELD(VTYPE, VSEW, 3, 3)
 FIELD(VTYPE, VTA, 6, 1)
@@ -134,6 +149,11 @@ struct CPUArchState {
     uint64_t vreg[32 * RV_VLEN_MAX / 64] QEMU_ALIGNED(16);
     target_ulong vxrm;
     target_ulong vxsat;
+    /*
+     * Saturation flags of the inline vsadd/vssub expansions, one per
+     * element; riscv_cpu_get_vxsat() folds them into vxsat.
+     */
+    uint64_t vxsat_vec[8 * RV_VLEN_MAX / 64] QEMU_ALIGNED(16);
     target_ulong vl;
     target_ulong vstart;
     target_ulong vtype;
@@ -329,6 +349,27 @@ struct CPUArchState {
     uint64_t menvcfg;
     target_ulong senvcfg;
     uint64_t henvcfg;
+
+    /* sfence.vma statistics, reported by "info tlb" */
+    uint64_t sfence_vma_full;
+    uint64_t sfence_vma_page;
+    uint64_t sfence_vma_skipped;
+
+    /*
+     * ASID-tagged TLB slots: the satp each slot caches translations for,
+     * and the LRU stamp used to recycle them.  See riscv_cpu_mmu_index().
+     */
+    target_ulong asid_slot_satp[RISCV_TLB_ASID_SLOTS];
+    uint64_t asid_slot_stamp[RISCV_TLB_ASID_SLOTS];
+    uint64_t asid_slot_clock;
+    uint32_t asid_slot_valid;
+    uint32_t asid_slot;
+    uint64_t asid_tlb_hit;
+    uint64_t asid_tlb_miss;
+
+    RISCVPWCEntry pwc[RISCV_PWC_ENTRIES];
+    uint64_t pwc_hit;
+    uint64_t pwc_miss;
 #endif
     target_ulong cur_pmmask;
     target_ulong cur_pmbase;
@@ -432,6 +473,7 @@ struct RISCVCPUConfig {
     bool epmp;
     bool aia;
     bool debug;
+    bool asid_tlb;
     uint64_t resetvec;
 
     bool short_isa_string;
@@ -502,6 +544,8 @@ bool riscv_cpu_virt_enabled(CPURISCVState *env);
 void riscv_cpu_set_virt_enabled(CPURISCVState *env, bool enable);
 bool riscv_cpu_two_stage_lookup(int mmu_idx);
 int riscv_cpu_mmu_index(CPURISCVState *env, bool ifetch);
+void riscv_cpu_asid_tlb_switch(CPURISCVState *env);
+void riscv_cpu_pwc_flush(CPURISCVState *env);
 hwaddr riscv_cpu_get_phys_page_debug(CPUState *cpu, vaddr addr);
 G_NORETURN void  riscv_cpu_do_unaligned_access(CPUState *cs, vaddr addr,
                                                MMUAccessType access_type, int mmu_idx,
@@ -544,15 +588,46 @@ G_NORETURN void riscv_raise_exception(CPURISCVState *env,
 
 target_ulong riscv_cpu_get_fflags(CPURISCVState *env);
 void riscv_cpu_set_fflags(CPURISCVState *env, target_ulong);
+void riscv_cpu_sync_fflags(CPURISCVState *env);
+void riscv_cpu_clear_host_fflags(void);
+
+target_ulong riscv_cpu_get_vxsat(CPURISCVState *env);
+void riscv_cpu_set_vxsat(CPURISCVState *env, target_ulong);
 
 #define TB_FLAGS_PRIV_MMU_MASK                3
 #define TB_FLAGS_PRIV_HYP_ACCESS_MASK   (1 << 2)
 #define TB_FLAGS_MSTATUS_FS MSTATUS_FS
 #define TB_FLAGS_MSTATUS_VS MSTATUS_VS
 
+/* MMU index of U or S mode accesses through ASID slot @slot */
+static inline int riscv_asid_mmu_idx(int priv, int slot)
+{
+    if (slot == 0) {
+        return priv;
+    }
+    return RISCV_ASID_MMU_IDX_BASE + 2 * (slot - 1) + priv;
+}
+
+/* Privilege level an MMU index translates for */
+static inline int riscv_mmu_idx_priv(int mmu_idx)
+{
+    if (mmu_idx >= RISCV_ASID_MMU_IDX_BASE) {
+        return mmu_idx & 1;
+    }
+    return mmu_idx & TB_FLAGS_PRIV_MMU_MASK;
+}
+
+/* Bitmap of the U and S mode MMU indexes of ASID slot @slot */
+static inline uint16_t riscv_asid_slot_idxmap(int slot)
+{
+    return (1 << riscv_asid_mmu_idx(PRV_U, slot)) |
+           (1 << riscv_asid_mmu_idx(PRV_S, slot));
+}
+
 #include "exec/cpu-all.h"
 
-FIELD(TB_FLAGS, MEM_IDX, 0, 3)
+/* Privilege level the TB was translated for (always PRV_U in user mode) */
+FIELD(TB_FLAGS, PRIV, 0, 2)
 FIELD(TB_FLAGS, LMUL, 3, 3)
 FIELD(TB_FLAGS, SEW, 6, 3)
 /* Skip MSTATUS_VS (0x600) bits */
@@ -569,6 +644,7 @@ FIELD(TB_FLAGS, XL, 20, 2)
 FIELD(TB_FLAGS, PM_MASK_ENABLED, 22, 1)
 FIELD(TB_FLAGS, PM_BASE_ENABLED, 23, 1)
 FIELD(TB_FLAGS, VTA, 24, 1)
+FIELD(TB_FLAGS, MEM_IDX, 25, 4)
 
 #ifdef TARGET_RISCV32
 #define riscv_cpu_mxl(env)  ((void)(env), MXL_RV32)
@@ -709,6 +785,12 @@ typedef struct {
     riscv_csr_write128_fn write128;
     /* The default priv spec version should be PRIV_VERSION_1_10_0 (i.e 0) */
     uint32_t min_priv_ver;
+    /*
+     * Writing this CSR only updates its own storage and does not change
+     * any state cached in the TB flags or the DisasContext, so the
+     * translator may continue the TB after the write.
+     */
+    bool write_keeps_tb;
 } riscv_csr_operations;
 
 /* CSR function table constants */
@@ -31,7 +31,10 @@ int riscv_cpu_mmu_index(CPURISCVState *env, bool ifetch)
 #ifdef CONFIG_USER_ONLY
     return 0;
 #else
-    return env->priv;
+    if (env->priv == PRV_M || riscv_cpu_virt_enabled(env)) {
+        return env->priv;
+    }
+    return riscv_asid_mmu_idx(env->priv, env->asid_slot);
 #endif
 }
 
@@ -75,7 +78,8 @@ void cpu_get_tb_cpu_state(CPURISCVState *env, target_ulong *pc,
     flags |= TB_FLAGS_MSTATUS_FS;
     flags |= TB_FLAGS_MSTATUS_VS;
 #else
-    flags |= cpu_mmu_index(env, 0);
+    flags = FIELD_DP32(flags, TB_FLAGS, PRIV, env->priv);
+    flags = FIELD_DP32(flags, TB_FLAGS, MEM_IDX, cpu_mmu_index(env, 0));
     if (riscv_cpu_fp_enabled(env)) {
         flags |= env->mstatus & MSTATUS_FS;
     }
@@ -567,6 +571,7 @@ void riscv_cpu_set_virt_enabled(CPURISCVState *env, bool enable)
 
     /* Flush the TLB on all virt mode changes. */
     if (get_field(env->virt, VIRT_ONOFF) != enable) {
+        riscv_cpu_pwc_flush(env);
         tlb_flush(env_cpu(env));
     }
 
@@ -588,7 +593,59 @@ void riscv_cpu_set_virt_enabled(CPURISCVState *env, bool enable)
 
 bool riscv_cpu_two_stage_lookup(int mmu_idx)
 {
-    return mmu_idx & TB_FLAGS_PRIV_HYP_ACCESS_MASK;
+    return mmu_idx < RISCV_ASID_MMU_IDX_BASE &&
+           (mmu_idx & TB_FLAGS_PRIV_HYP_ACCESS_MASK);
+}
+
+/*
+ * Called after satp was written with x-asid-tlb enabled.  Instead of
+ * flushing the whole TLB, switch U and S mode accesses to the ASID slot
+ * whose translations were made with this satp, or recycle the least
+ * recently used slot.  M mode (through MPRV) and HLV/HSV entries don't
+ * carry a slot and are still flushed.
+ */
+void riscv_cpu_asid_tlb_switch(CPURISCVState *env)
+{
+    uint16_t idxmap = (1 << PRV_M) |
+                      (1 << (PRV_U | TB_FLAGS_PRIV_HYP_ACCESS_MASK)) |
+                      (1 << (PRV_S | TB_FLAGS_PRIV_HYP_ACCESS_MASK)) |
+                      (1 << (PRV_M | TB_FLAGS_PRIV_HYP_ACCESS_MASK));
+    int slot, victim = 0;
+
+    for (slot = 0; slot < RISCV_TLB_ASID_SLOTS; slot++) {
+        if ((env->asid_slot_valid & (1 << slot)) &&
+            env->asid_slot_satp[slot] == env->satp) {
+            break;
+        }
+        if (env->asid_slot_stamp[slot] < env->asid_slot_stamp[victim]) {
+            victim = slot;
+        }
+    }
+
+    if (slot < RISCV_TLB_ASID_SLOTS) {
+        env->asid_tlb_hit++;
+    } else {
+        slot = victim;
+        env->asid_tlb_miss++;
+        env->asid_slot_satp[slot] = env->satp;
+        env->asid_slot_valid |= 1 << slot;
+        idxmap |= riscv_asid_slot_idxmap(slot);
+    }
+
+    env->asid_slot_stamp[slot] = ++env->asid_slot_clock;
+    env->asid_slot = slot;
+    tlb_flush_by_mmuidx(env_cpu(env), idxmap);
+}
+
+/*
+ * Forget all cached upper-level page table walks, e.g. because the page
+ * tables may have changed (sfence.vma) or the PMP checks that were done
+ * when loading them may no longer hold.
+ */
+void riscv_cpu_pwc_flush(CPURISCVState *env)
+{
+    trace_riscv_pwc_flush(env->mhartid, env->pwc_hit, env->pwc_miss);
+    memset(env->pwc, 0, sizeof(env->pwc));
 }
 
 int riscv_cpu_claim_interrupts(RISCVCPU *cpu, uint64_t interrupts)
@@ -732,6 +789,9 @@ static int get_physical_address_pmp(CPURISCVState *env, int *prot,
  * @env: CPURISCVState
  * @physical: This will be set to the calculated physical address
  * @prot: The returned protection attributes
+ * @page_size: If not NULL, this will be set to the size of the leaf page,
+ *             for superpages and NAPOT ranges; it is left alone when no
+ *             page table is used
  * @addr: The virtual address to be translated
  * @fault_pte_addr: If not NULL, this will be set to fault pte address
  *                  when a error occurs on pte address translation.
@@ -744,7 +804,8 @@ static int get_physical_address_pmp(CPURISCVState *env, int *prot,
  * @is_debug: Is this access from a debugger or the monitor?
  */
 static int get_physical_address(CPURISCVState *env, hwaddr *physical,
-                                int *prot, target_ulong addr,
+                                int *prot, target_ulong *page_size,
+                                target_ulong addr,
                                 target_ulong *fault_pte_addr,
                                 int access_type, int mmu_idx,
                                 bool first_stage, bool two_stage,
@@ -755,7 +816,7 @@ static int get_physical_address(CPURISCVState *env, hwaddr *physical,
      * (riscv_cpu_do_interrupt) is correct */
     MemTxResult res;
     MemTxAttrs attrs = MEMTXATTRS_UNSPECIFIED;
-    int mode = mmu_idx & TB_FLAGS_PRIV_MMU_MASK;
+    int mode = riscv_mmu_idx_priv(mmu_idx);
     bool use_background = false;
     hwaddr ppn;
     RISCVCPU *cpu = env_archcpu(env);
@@ -869,13 +930,40 @@ static int get_physical_address(CPURISCVState *env, hwaddr *physical,
         return TRANSLATE_FAIL;
     }
 
-    int ptshift = (levels - 1) * ptidxbits;
+    int ptshift;
     int i;
+    hwaddr root = base;
+    target_ulong pwc_vpn = addr >> (PGSHIFT + ptidxbits);
+    RISCVPWCEntry *pwc = NULL;
+
+    /*
+     * Single stage walks may start from the leaf page table.  Debug
+     * accesses come from the monitor or gdbstub thread and must not
+     * touch the cache of the vCPU.
+     */
+    if (first_stage && !two_stage && !is_debug) {
+        pwc = &env->pwc[pwc_vpn % RISCV_PWC_ENTRIES];
+    }
 
 #if !TCG_OVERSIZED_GUEST
 restart:
 #endif
-    for (i = 0; i < levels; i++, ptshift -= ptidxbits) {
+    i = 0;
+    ptshift = (levels - 1) * ptidxbits;
+    base = root;
+    if (pwc) {
+        if (pwc->valid && pwc->satp == env->satp && pwc->vpn == pwc_vpn) {
+            env->pwc_hit++;
+            trace_riscv_pwc_hit(env->mhartid, addr, env->pwc_hit);
+            i = levels - 1;
+            ptshift = 0;
+            base = pwc->base;
+        } else {
+            env->pwc_miss++;
+            trace_riscv_pwc_miss(env->mhartid, addr, env->pwc_miss);
+        }
+    }
+    for (; i < levels; i++, ptshift -= ptidxbits) {
         target_ulong idx;
         if (i == 0) {
             idx = (addr >> (PGSHIFT + ptshift)) &
@@ -894,7 +982,8 @@ restart:
 
             /* Do the second stage translation on the base PTE address. */
             int vbase_ret = get_physical_address(env, &vbase, &vbase_prot,
-                                                 base, NULL, MMU_DATA_LOAD,
+                                                 NULL, base, NULL,
+                                                 MMU_DATA_LOAD,
                                                  mmu_idx, false, true,
                                                  is_debug);
 
@@ -951,6 +1040,12 @@ restart:
                 return TRANSLATE_FAIL;
             }
             base = ppn << PGSHIFT;
+            if (pwc && i == levels - 2) {
+                pwc->satp = env->satp;
+                pwc->vpn = pwc_vpn;
+                pwc->base = base;
+                pwc->valid = true;
+            }
         } else if ((pte & (PTE_R | PTE_W | PTE_X)) == PTE_W) {
             /* Reserved leaf PTE flags: PTE_W */
             return TRANSLATE_FAIL;
@@ -1035,6 +1130,10 @@ restart:
             *physical = (((ppn & ~napot_mask) | (vpn & napot_mask) |
                           (vpn & (((target_ulong)1 << ptshift) - 1))
                          ) << PGSHIFT) | (addr & ~TARGET_PAGE_MASK);
+            if (page_size) {
+                *page_size = (target_ulong)1 <<
+                             (PGSHIFT + (napot_bits ? napot_bits : ptshift));
+            }
 
             /* set permissions on the TLB entry */
             if ((pte & PTE_R) || ((pte & PTE_X) && mxr)) {
@@ -1117,14 +1216,15 @@ hwaddr riscv_cpu_get_phys_page_debug(CPUState *cs, vaddr addr)
     int prot;
     int mmu_idx = cpu_mmu_index(&cpu->env, false);
 
-    if (get_physical_address(env, &phys_addr, &prot, addr, NULL, 0, mmu_idx,
-                             true, riscv_cpu_virt_enabled(env), true)) {
+    if (get_physical_address(env, &phys_addr, &prot, NULL, addr, NULL, 0,
+                             mmu_idx, true, riscv_cpu_virt_enabled(env),
+                             true)) {
         return -1;
     }
 
     if (riscv_cpu_virt_enabled(env)) {
-        if (get_physical_address(env, &phys_addr, &prot, phys_addr, NULL,
-                                 0, mmu_idx, false, true, true)) {
+        if (get_physical_address(env, &phys_addr, &prot, NULL, phys_addr,
+                                 NULL, 0, mmu_idx, false, true, true)) {
             return -1;
         }
     }
@@ -1193,9 +1293,11 @@ bool riscv_cpu_tlb_fill(CPUState *cs, vaddr address, int size,
     bool first_stage_error = true;
     bool two_stage_lookup = false;
     int ret = TRANSLATE_FAIL;
-    int mode = mmu_idx;
+    int mode = riscv_mmu_idx_priv(mmu_idx);
     /* default TLB page size */
     target_ulong tlb_size = TARGET_PAGE_SIZE;
+    /* size of the leaf page of each stage, for flushing superpages */
+    target_ulong page_size = TARGET_PAGE_SIZE, page_size2 = TARGET_PAGE_SIZE;
 
     env->guest_phys_fault_addr = 0;
 
@@ -1218,7 +1320,7 @@ bool riscv_cpu_tlb_fill(CPUState *cs, vaddr address, int size,
         ((riscv_cpu_two_stage_lookup(mmu_idx) || two_stage_lookup) &&
          access_type != MMU_INST_FETCH)) {
         /* Two stage lookup */
-        ret = get_physical_address(env, &pa, &prot, address,
+        ret = get_physical_address(env, &pa, &prot, &page_size, address,
                                    &env->guest_phys_fault_addr, access_type,
                                    mmu_idx, true, true, false);
 
@@ -1241,9 +1343,10 @@ bool riscv_cpu_tlb_fill(CPUState *cs, vaddr address, int size,
             /* Second stage lookup */
             im_address = pa;
 
-            ret = get_physical_address(env, &pa, &prot2, im_address, NULL,
-                                       access_type, mmu_idx, false, true,
-                                       false);
+            ret = get_physical_address(env, &pa, &prot2, &page_size2,
+                                       im_address, NULL, access_type,
+                                       mmu_idx, false, true, false);
+            page_size = MIN(page_size, page_size2);
 
             qemu_log_mask(CPU_LOG_MMU,
                     "%s 2nd-stage address=%" VADDR_PRIx " ret %d physical "
@@ -1277,8 +1380,9 @@ bool riscv_cpu_tlb_fill(CPUState *cs, vaddr address, int size,
         }
     } else {
         /* Single stage lookup */
-        ret = get_physical_address(env, &pa, &prot, address, NULL,
-                                   access_type, mmu_idx, true, false, false);
+        ret = get_physical_address(env, &pa, &prot, &page_size, address,
+                                   NULL, access_type, mmu_idx, true, false,
+                                   false);
 
         qemu_log_mask(CPU_LOG_MMU,
                       "%s address=%" VADDR_PRIx " ret %d physical "
@@ -1303,8 +1407,18 @@ bool riscv_cpu_tlb_fill(CPUState *cs, vaddr address, int size,
     }
 
     if (ret == TRANSLATE_SUCCESS) {
-        tlb_set_page(cs, address & ~(tlb_size - 1), pa & ~(tlb_size - 1),
-                     prot, mmu_idx, tlb_size);
+        /*
+         * Only the page is mapped, but report the leaf size to cputlb so
+         * that sfence.vma of any page of a superpage flushes it too.  PMP
+         * regions smaller than a page keep their own size.
+         */
+        if (tlb_size == TARGET_PAGE_SIZE) {
+            tlb_set_page(cs, address & TARGET_PAGE_MASK,
+                         pa & TARGET_PAGE_MASK, prot, mmu_idx, page_size);
+        } else {
+            tlb_set_page(cs, address & ~(tlb_size - 1), pa & ~(tlb_size - 1),
+                         prot, mmu_idx, tlb_size);
+        }
         return true;
     } else if (probe) {
         return false;
@@ -454,7 +454,7 @@ static RISCVException write_vxrm(CPURISCVState *env, int csrno,
 static RISCVException read_vxsat(CPURISCVState *env, int csrno,
                                  target_ulong *val)
 {
-    *val = env->vxsat;
+    *val = riscv_cpu_get_vxsat(env);
     return RISCV_EXCP_NONE;
 }
 
@@ -464,7 +464,7 @@ static RISCVException write_vxsat(CPURISCVState *env, int csrno,
 #if !defined(CONFIG_USER_ONLY)
     env->mstatus |= MSTATUS_VS;
 #endif
-    env->vxsat = val;
+    riscv_cpu_set_vxsat(env, val);
     return RISCV_EXCP_NONE;
 }
 
@@ -491,7 +491,8 @@ static RISCVException write_vstart(CPURISCVState *env, int csrno,
 
 static int read_vcsr(CPURISCVState *env, int csrno, target_ulong *val)
 {
-    *val = (env->vxrm << VCSR_VXRM_SHIFT) | (env->vxsat << VCSR_VXSAT_SHIFT);
+    *val = (env->vxrm << VCSR_VXRM_SHIFT) |
+           (riscv_cpu_get_vxsat(env) << VCSR_VXSAT_SHIFT);
     return RISCV_EXCP_NONE;
 }
 
@@ -501,7 +502,7 @@ static int write_vcsr(CPURISCVState *env, int csrno, target_ulong val)
     env->mstatus |= MSTATUS_VS;
 #endif
     env->vxrm = (val & VCSR_VXRM) >> VCSR_VXRM_SHIFT;
-    env->vxsat = (val & VCSR_VXSAT) >> VCSR_VXSAT_SHIFT;
+    riscv_cpu_set_vxsat(env, (val & VCSR_VXSAT) >> VCSR_VXSAT_SHIFT);
     return RISCV_EXCP_NONE;
 }
 
@@ -2047,9 +2048,19 @@ static RISCVException write_satp(CPURISCVState *env, int csrno,
              * pass these through QEMU's TLB emulation as it improves
              * performance.  Flushing the TLB on SATP writes with paging
              * enabled avoids leaking those invalid cached mappings.
+             *
+             * With x-asid-tlb the mappings of each satp live in their own
+             * MMU indexes instead, so only switch to those.  The page-walk
+             * cache is small and is flushed either way.
              */
-            tlb_flush(env_cpu(env));
             env->satp = val;
+            riscv_cpu_pwc_flush(env);
+            if (RISCV_CPU(env_cpu(env))->cfg.asid_tlb &&
+                !riscv_cpu_virt_enabled(env)) {
+                riscv_cpu_asid_tlb_switch(env);
+            } else {
+                tlb_flush(env_cpu(env));
+            }
         }
     }
     return RISCV_EXCP_NONE;
@@ -2411,6 +2422,7 @@ static RISCVException write_hgatp(CPURISCVState *env, int csrno,
                                   target_ulong val)
 {
     env->hgatp = val;
+    riscv_cpu_pwc_flush(env);
     return RISCV_EXCP_NONE;
 }
 
@@ -2665,6 +2677,7 @@ static RISCVException write_vsatp(CPURISCVState *env, int csrno,
                                   target_ulong val)
 {
     env->vsatp = val;
+    riscv_cpu_pwc_flush(env);
     return RISCV_EXCP_NONE;
 }
 
@@ -3387,19 +3400,26 @@ riscv_csr_operations csr_ops[CSR_TABLE_SIZE] = {
     [CSR_MISA]        = { "misa",       any,   read_misa,        write_misa, NULL,
                                                read_misa_i128                      },
     [CSR_MIDELEG]     = { "mideleg",    any,   NULL,    NULL,    rmw_mideleg       },
-    [CSR_MEDELEG]     = { "medeleg",    any,   read_medeleg,     write_medeleg     },
+    [CSR_MEDELEG]     = { "medeleg",    any,   read_medeleg,     write_medeleg,
+                                               .write_keeps_tb = true },
     [CSR_MIE]         = { "mie",        any,   NULL,    NULL,    rmw_mie           },
-    [CSR_MTVEC]       = { "mtvec",      any,   read_mtvec,       write_mtvec       },
-    [CSR_MCOUNTEREN]  = { "mcounteren", any,   read_mcounteren,  write_mcounteren  },
+    [CSR_MTVEC]       = { "mtvec",      any,   read_mtvec,       write_mtvec,
+                                               .write_keeps_tb = true },
+    [CSR_MCOUNTEREN]  = { "mcounteren", any,   read_mcounteren,  write_mcounteren,
+                                               .write_keeps_tb = true },
 
     [CSR_MSTATUSH]    = { "mstatush",   any32, read_mstatush,    write_mstatush    },
 
     /* Machine Trap Handling */
     [CSR_MSCRATCH] = { "mscratch", any,  read_mscratch,      write_mscratch, NULL,
-                                         read_mscratch_i128, write_mscratch_i128   },
-    [CSR_MEPC]     = { "mepc",     any,  read_mepc,     write_mepc     },
-    [CSR_MCAUSE]   = { "mcause",   any,  read_mcause,   write_mcause   },
-    [CSR_MTVAL]    = { "mtval",    any,  read_mtval,    write_mtval    },
+                                         read_mscratch_i128, write_mscratch_i128,
+                                         .write_keeps_tb = true },
+    [CSR_MEPC]     = { "mepc",     any,  read_mepc,     write_mepc,
+                                         .write_keeps_tb = true },
+    [CSR_MCAUSE]   = { "mcause",   any,  read_mcause,   write_mcause,
+                                         .write_keeps_tb = true },
+    [CSR_MTVAL]    = { "mtval",    any,  read_mtval,    write_mtval,
+                                         .write_keeps_tb = true },
     [CSR_MIP]      = { "mip",      any,  NULL,    NULL, rmw_mip        },
 
     /* Machine-Level Window to Indirectly Accessed Registers (AIA) */
@@ -3443,15 +3463,21 @@ riscv_csr_operations csr_ops[CSR_TABLE_SIZE] = {
     [CSR_SSTATUS]    = { "sstatus",    smode, read_sstatus,    write_sstatus, NULL,
                                               read_sstatus_i128                 },
     [CSR_SIE]        = { "sie",        smode, NULL,   NULL,    rmw_sie          },
-    [CSR_STVEC]      = { "stvec",      smode, read_stvec,      write_stvec      },
-    [CSR_SCOUNTEREN] = { "scounteren", smode, read_scounteren, write_scounteren },
+    [CSR_STVEC]      = { "stvec",      smode, read_stvec,      write_stvec,
+                                              .write_keeps_tb = true },
+    [CSR_SCOUNTEREN] = { "scounteren", smode, read_scounteren, write_scounteren,
+                                              .write_keeps_tb = true },
 
     /* Supervisor Trap Handling */
     [CSR_SSCRATCH] = { "sscratch", smode, read_sscratch, write_sscratch, NULL,
-                                          read_sscratch_i128, write_sscratch_i128  },
-    [CSR_SEPC]     = { "sepc",     smode, read_sepc,     write_sepc     },
-    [CSR_SCAUSE]   = { "scause",   smode, read_scause,   write_scause   },
-    [CSR_STVAL]    = { "stval",    smode, read_stval,   write_stval   },
+                                          read_sscratch_i128, write_sscratch_i128,
+                                          .write_keeps_tb = true },
+    [CSR_SEPC]     = { "sepc",     smode, read_sepc,     write_sepc,
+                                          .write_keeps_tb = true },
+    [CSR_SCAUSE]   = { "scause",   smode, read_scause,   write_scause,
+                                          .write_keeps_tb = true },
+    [CSR_STVAL]    = { "stval",    smode, read_stval,   write_stval,
+                                          .write_keeps_tb = true },
     [CSR_SIP]      = { "sip",      smode, NULL,    NULL, rmw_sip        },
 
     /* Supervisor Protection and Translation */
@@ -3478,7 +3504,8 @@ riscv_csr_operations csr_ops[CSR_TABLE_SIZE] = {
     [CSR_HSTATUS]     = { "hstatus",     hmode,   read_hstatus,   write_hstatus,
                                          .min_priv_ver = PRIV_VERSION_1_12_0 },
     [CSR_HEDELEG]     = { "hedeleg",     hmode,   read_hedeleg,   write_hedeleg,
-                                         .min_priv_ver = PRIV_VERSION_1_12_0 },
+                                         .min_priv_ver = PRIV_VERSION_1_12_0,
+                                         .write_keeps_tb = true },
     [CSR_HIDELEG]     = { "hideleg",     hmode,   NULL,   NULL, rmw_hideleg,
                                          .min_priv_ver = PRIV_VERSION_1_12_0 },
     [CSR_HVIP]        = { "hvip",        hmode,   NULL,   NULL,   rmw_hvip,
@@ -3488,13 +3515,16 @@ riscv_csr_operations csr_ops[CSR_TABLE_SIZE] = {
     [CSR_HIE]         = { "hie",         hmode,   NULL,   NULL,    rmw_hie,
                                          .min_priv_ver = PRIV_VERSION_1_12_0 },
     [CSR_HCOUNTEREN]  = { "hcounteren",  hmode,   read_hcounteren, write_hcounteren,
-                                         .min_priv_ver = PRIV_VERSION_1_12_0 },
+                                         .min_priv_ver = PRIV_VERSION_1_12_0,
+                                         .write_keeps_tb = true },
     [CSR_HGEIE]       = { "hgeie",       hmode,   read_hgeie,       write_hgeie,
                                          .min_priv_ver = PRIV_VERSION_1_12_0 },
     [CSR_HTVAL]       = { "htval",       hmode,   read_htval,     write_htval,
-                                         .min_priv_ver = PRIV_VERSION_1_12_0 },
+                                         .min_priv_ver = PRIV_VERSION_1_12_0,
+                                         .write_keeps_tb = true },
     [CSR_HTINST]      = { "htinst",      hmode,   read_htinst,    write_htinst,
-                                         .min_priv_ver = PRIV_VERSION_1_12_0 },
+                                         .min_priv_ver = PRIV_VERSION_1_12_0,
+                                         .write_keeps_tb = true },
     [CSR_HGEIP]       = { "hgeip",       hmode,   read_hgeip,
                                          .min_priv_ver = PRIV_VERSION_1_12_0 },
     [CSR_HGATP]       = { "hgatp",       hmode,   read_hgatp,     write_hgatp,
@@ -3511,22 +3541,29 @@ riscv_csr_operations csr_ops[CSR_TABLE_SIZE] = {
     [CSR_VSIE]        = { "vsie",        hmode,   NULL,    NULL,    rmw_vsie ,
                                          .min_priv_ver = PRIV_VERSION_1_12_0 },
     [CSR_VSTVEC]      = { "vstvec",      hmode,   read_vstvec,    write_vstvec,
-                                         .min_priv_ver = PRIV_VERSION_1_12_0 },
+                                         .min_priv_ver = PRIV_VERSION_1_12_0,
+                                         .write_keeps_tb = true },
     [CSR_VSSCRATCH]   = { "vsscratch",   hmode,   read_vsscratch, write_vsscratch,
-                                         .min_priv_ver = PRIV_VERSION_1_12_0 },
+                                         .min_priv_ver = PRIV_VERSION_1_12_0,
+                                         .write_keeps_tb = true },
     [CSR_VSEPC]       = { "vsepc",       hmode,   read_vsepc,     write_vsepc,
-                                         .min_priv_ver = PRIV_VERSION_1_12_0 },
+                                         .min_priv_ver = PRIV_VERSION_1_12_0,
+                                         .write_keeps_tb = true },
     [CSR_VSCAUSE]     = { "vscause",     hmode,   read_vscause,   write_vscause,
-                                         .min_priv_ver = PRIV_VERSION_1_12_0 },
+                                         .min_priv_ver = PRIV_VERSION_1_12_0,
+                                         .write_keeps_tb = true },
     [CSR_VSTVAL]      = { "vstval",      hmode,   read_vstval,    write_vstval,
-                                         .min_priv_ver = PRIV_VERSION_1_12_0 },
+                                         .min_priv_ver = PRIV_VERSION_1_12_0,
+                                         .write_keeps_tb = true },
     [CSR_VSATP]       = { "vsatp",       hmode,   read_vsatp,     write_vsatp,
                                          .min_priv_ver = PRIV_VERSION_1_12_0 },
 
     [CSR_MTVAL2]      = { "mtval2",      hmode,   read_mtval2,    write_mtval2,
-                                         .min_priv_ver = PRIV_VERSION_1_12_0 },
+                                         .min_priv_ver = PRIV_VERSION_1_12_0,
+                                         .write_keeps_tb = true },
     [CSR_MTINST]      = { "mtinst",      hmode,   read_mtinst,    write_mtinst,
-                                         .min_priv_ver = PRIV_VERSION_1_12_0 },
+                                         .min_priv_ver = PRIV_VERSION_1_12_0,
+                                         .write_keeps_tb = true },
 
     /* Virtual Interrupts and Interrupt Priorities (H-extension with AIA) */
     [CSR_HVIEN]       = { "hvien",       aia_hmode, read_zero, write_ignore },
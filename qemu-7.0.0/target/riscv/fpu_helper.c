@@ -17,6 +17,7 @@
  */
 
 #include "qemu/osdep.h"
+#include <fenv.h>
 #include "cpu.h"
 #include "qemu/host-utils.h"
 #include "exec/exec-all.h"
@@ -24,11 +25,39 @@
 #include "fpu/softfloat.h"
 #include "internals.h"
 
+/*
+ * Hardfloat only runs while float_flag_inexact is set, but guests clear
+ * fflags often.  fp_status.inexact_in_host lets it run regardless, and
+ * the inexact flag of its results accrues in the host's sticky
+ * FE_INEXACT instead.  The host flag is cleared when the vCPU starts
+ * executing and whenever the guest writes fflags, and merged back into
+ * fp_status before fflags is read and when the vCPU stops.
+ */
+void riscv_cpu_sync_fflags(CPURISCVState *env)
+{
+    /* The host flag is per thread; others see the state merged on exit */
+    if (current_cpu != env_cpu(env)) {
+        return;
+    }
+    if (fetestexcept(FE_INEXACT)) {
+        float_raise(float_flag_inexact, &env->fp_status);
+        feclearexcept(FE_INEXACT);
+    }
+}
+
+void riscv_cpu_clear_host_fflags(void)
+{
+    feclearexcept(FE_INEXACT);
+}
+
 target_ulong riscv_cpu_get_fflags(CPURISCVState *env)
 {
-    int soft = get_float_exception_flags(&env->fp_status);
+    int soft;
     target_ulong hard = 0;
 
+    riscv_cpu_sync_fflags(env);
+    soft = get_float_exception_flags(&env->fp_status);
+
     hard |= (soft & float_flag_inexact) ? FPEXC_NX : 0;
     hard |= (soft & float_flag_underflow) ? FPEXC_UF : 0;
     hard |= (soft & float_flag_overflow) ? FPEXC_OF : 0;
@@ -49,6 +78,9 @@ void riscv_cpu_set_fflags(CPURISCVState *env, target_ulong hard)
     soft |= (hard & FPEXC_NV) ? float_flag_invalid : 0;
 
     set_float_exception_flags(soft, &env->fp_status);
+    if (current_cpu == env_cpu(env)) {
+        feclearexcept(FE_INEXACT);
+    }
 }
 
 void helper_set_rounding_mode(CPURISCVState *env, uint32_t rm)
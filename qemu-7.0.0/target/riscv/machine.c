@@ -128,11 +128,22 @@ static bool vector_needed(void *opaque)
     return riscv_has_ext(env, RVV);
 }
 
+static int vector_pre_save(void *opaque)
+{
+    RISCVCPU *cpu = opaque;
+    CPURISCVState *env = &cpu->env;
+
+    /* vxsat_vec is not migrated */
+    riscv_cpu_set_vxsat(env, riscv_cpu_get_vxsat(env));
+    return 0;
+}
+
 static const VMStateDescription vmstate_vector = {
     .name = "cpu/vector",
     .version_id = 2,
     .minimum_version_id = 2,
     .needed = vector_needed,
+    .pre_save = vector_pre_save,
     .fields = (VMStateField[]) {
             VMSTATE_UINT64_ARRAY(env.vreg, RISCVCPU, 32 * RV_VLEN_MAX / 64),
             VMSTATE_UINTTL(env.vxrm, RISCVCPU),
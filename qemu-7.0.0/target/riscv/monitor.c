@@ -237,3 +237,45 @@ void hmp_info_mem(Monitor *mon, const QDict *qdict)
 
     mem_info_svxx(mon, env);
 }
+
+void hmp_info_tlb(Monitor *mon, const QDict *qdict)
+{
+    CPUArchState *env;
+    int i;
+
+    env = mon_get_cpu_env(mon);
+    if (!env) {
+        monitor_printf(mon, "No CPU available\n");
+        return;
+    }
+
+    monitor_printf(mon, "sfence.vma full flushes:   %" PRIu64 "\n",
+                   env->sfence_vma_full);
+    monitor_printf(mon, "sfence.vma page flushes:   %" PRIu64 "\n",
+                   env->sfence_vma_page);
+    monitor_printf(mon, "sfence.vma other ASID:     %" PRIu64 "\n",
+                   env->sfence_vma_skipped);
+    monitor_printf(mon, "full flushes avoided:      %" PRIu64 "\n",
+                   env->sfence_vma_page + env->sfence_vma_skipped);
+    monitor_printf(mon, "page-walk cache hits:      %" PRIu64 "\n",
+                   env->pwc_hit);
+    monitor_printf(mon, "page-walk cache misses:    %" PRIu64 "\n",
+                   env->pwc_miss);
+
+    if (!RISCV_CPU(env_cpu(env))->cfg.asid_tlb) {
+        return;
+    }
+
+    monitor_printf(mon, "ASID slot hits:            %" PRIu64 "\n",
+                   env->asid_tlb_hit);
+    monitor_printf(mon, "ASID slot misses:          %" PRIu64 "\n",
+                   env->asid_tlb_miss);
+    for (i = 0; i < RISCV_TLB_ASID_SLOTS; i++) {
+        if (!(env->asid_slot_valid & (1 << i))) {
+            continue;
+        }
+        monitor_printf(mon, "slot %d%s satp " TARGET_FMT_lx "\n", i,
+                       i == env->asid_slot ? "*" : " ",
+                       env->asid_slot_satp[i]);
+    }
+}
@@ -245,19 +245,115 @@ void helper_wfi(CPURISCVState *env)
     }
 }
 
-void helper_tlb_flush(CPURISCVState *env)
+static void check_sfence_vma(CPURISCVState *env, uintptr_t ra)
 {
-    CPUState *cs = env_cpu(env);
     if (!(env->priv >= PRV_S) ||
         (env->priv == PRV_S &&
          get_field(env->mstatus, MSTATUS_TVM))) {
-        riscv_raise_exception(env, RISCV_EXCP_ILLEGAL_INST, GETPC());
+        riscv_raise_exception(env, RISCV_EXCP_ILLEGAL_INST, ra);
     } else if (riscv_has_ext(env, RVH) && riscv_cpu_virt_enabled(env) &&
                get_field(env->hstatus, HSTATUS_VTVM)) {
-        riscv_raise_exception(env, RISCV_EXCP_VIRT_INSTRUCTION_FAULT, GETPC());
-    } else {
-        tlb_flush(cs);
+        riscv_raise_exception(env, RISCV_EXCP_VIRT_INSTRUCTION_FAULT, ra);
+    }
+}
+
+static bool satp_has_asid(CPURISCVState *env, target_ulong satp,
+                          target_ulong asid)
+{
+    if (riscv_cpu_mxl(env) == MXL_RV32) {
+        return get_field(satp, SATP32_ASID) ==
+               get_field(set_field(0, SATP32_ASID, asid), SATP32_ASID);
+    }
+    return get_field(satp, SATP64_ASID) ==
+           get_field(set_field(0, SATP64_ASID, asid), SATP64_ASID);
+}
+
+/*
+ * Only the U, S and M (through MPRV) MMU indexes hold translations made
+ * with satp; the HLV/HSV indexes use vsatp and are left alone.
+ */
+static uint16_t sfence_vma_idxmap(void)
+{
+    uint16_t idxmap = 1 << PRV_M;
+    int slot;
+
+    for (slot = 0; slot < RISCV_TLB_ASID_SLOTS; slot++) {
+        idxmap |= riscv_asid_slot_idxmap(slot);
+    }
+    return idxmap;
+}
+
+/*
+ * The softmmu TLB is not tagged with an ASID.  The indexes in use hold
+ * translations made through the current satp, because changing satp
+ * either flushes them or, with x-asid-tlb, switches to another ASID
+ * slot.  Each other valid ASID slot holds the translations of the satp
+ * it was assigned.  Anything else has nothing to drop for @asid.
+ */
+static uint16_t sfence_vma_asid_idxmap(CPURISCVState *env, target_ulong asid)
+{
+    uint16_t idxmap = 0;
+    int slot;
+
+    if (satp_has_asid(env, env->satp, asid)) {
+        slot = riscv_cpu_virt_enabled(env) ? 0 : env->asid_slot;
+        idxmap |= riscv_asid_slot_idxmap(slot) | (1 << PRV_M);
+    }
+    for (slot = 0; slot < RISCV_TLB_ASID_SLOTS; slot++) {
+        if ((env->asid_slot_valid & (1 << slot)) &&
+            satp_has_asid(env, env->asid_slot_satp[slot], asid)) {
+            idxmap |= riscv_asid_slot_idxmap(slot);
+        }
+    }
+    return idxmap;
+}
+
+void helper_tlb_flush(CPURISCVState *env)
+{
+    check_sfence_vma(env, GETPC());
+    riscv_cpu_pwc_flush(env);
+    env->sfence_vma_full++;
+    tlb_flush(env_cpu(env));
+}
+
+void helper_tlb_flush_page(CPURISCVState *env, target_ulong addr)
+{
+    check_sfence_vma(env, GETPC());
+    riscv_cpu_pwc_flush(env);
+    env->sfence_vma_page++;
+    tlb_flush_page_by_mmuidx(env_cpu(env), addr, sfence_vma_idxmap());
+}
+
+void helper_tlb_flush_asid(CPURISCVState *env, target_ulong asid)
+{
+    uint16_t idxmap;
+
+    check_sfence_vma(env, GETPC());
+    riscv_cpu_pwc_flush(env);
+    idxmap = sfence_vma_asid_idxmap(env, asid);
+    if (!idxmap) {
+        env->sfence_vma_skipped++;
+        return;
+    }
+    /* Global and non-global entries are indistinguishable in the TLB */
+    env->sfence_vma_full++;
+    tlb_flush_by_mmuidx(env_cpu(env), idxmap);
+}
+
+void helper_tlb_flush_page_asid(CPURISCVState *env, target_ulong addr,
+                                target_ulong asid)
+{
+    uint16_t idxmap;
+
+    check_sfence_vma(env, GETPC());
+    riscv_cpu_pwc_flush(env);
+    idxmap = sfence_vma_asid_idxmap(env, asid);
+    if (!idxmap) {
+        env->sfence_vma_skipped++;
+        return;
     }
+    env->sfence_vma_page++;
+    tlb_flush_page_by_mmuidx(env_cpu(env), addr, idxmap);
 }
 
 void helper_hyp_tlb_flush(CPURISCVState *env)
@@ -270,6 +366,7 @@ void helper_hyp_tlb_flush(CPURISCVState *env)
 
     if (env->priv == PRV_M ||
         (env->priv == PRV_S && !riscv_cpu_virt_enabled(env))) {
+        riscv_cpu_pwc_flush(env);
         tlb_flush(cs);
         return;
     }
@@ -289,14 +386,14 @@ void helper_hyp_gvma_tlb_flush(CPURISCVState *env)
 
 target_ulong helper_hyp_hlvx_hu(CPURISCVState *env, target_ulong address)
 {
-    int mmu_idx = cpu_mmu_index(env, true) | TB_FLAGS_PRIV_HYP_ACCESS_MASK;
+    int mmu_idx = env->priv | TB_FLAGS_PRIV_HYP_ACCESS_MASK;
 
     return cpu_lduw_mmuidx_ra(env, address, mmu_idx, GETPC());
 }
 
 target_ulong helper_hyp_hlvx_wu(CPURISCVState *env, target_ulong address)
 {
-    int mmu_idx = cpu_mmu_index(env, true) | TB_FLAGS_PRIV_HYP_ACCESS_MASK;
+    int mmu_idx = env->priv | TB_FLAGS_PRIV_HYP_ACCESS_MASK;
 
     return cpu_ldl_mmuidx_ra(env, address, mmu_idx, GETPC());
 }
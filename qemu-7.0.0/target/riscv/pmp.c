@@ -188,6 +188,61 @@ void pmp_update_rule_addr(CPURISCVState *env, uint32_t pmp_index)
     env->pmp_state.addr[pmp_index].ea = ea;
 }
 
+/*
+ * Split the address space at the start and end of every active entry and
+ * record, for each resulting range, the lowest numbered entry covering it.
+ * Any access that stays within one range is then decided by that entry.
+ */
+static void pmp_update_rule_segs(CPURISCVState *env)
+{
+    pmp_table_t *t = &env->pmp_state;
+    target_ulong bound[2 * MAX_RISCV_PMPS + 1];
+    int n = 0, i, j, k;
+
+    bound[n++] = 0;
+    for (i = 0; i < MAX_RISCV_PMPS; i++) {
+        if (pmp_get_a_field(t->pmp[i].cfg_reg) == PMP_AMATCH_OFF) {
+            continue;
+        }
+        bound[n++] = t->addr[i].sa;
+        if (t->addr[i].ea != (target_ulong)-1) {
+            bound[n++] = t->addr[i].ea + 1;
+        }
+    }
+
+    /* Insertion sort, dropping duplicates */
+    k = 0;
+    for (i = 0; i < n; i++) {
+        target_ulong b = bound[i];
+
+        j = 0;
+        while (j < k && t->seg[j].sa < b) {
+            j++;
+        }
+        if (j < k && t->seg[j].sa == b) {
+            continue;
+        }
+        memmove(&t->seg[j + 1], &t->seg[j], (k - j) * sizeof(pmp_seg_t));
+        t->seg[j].sa = b;
+        k++;
+    }
+
+    for (j = 0; j < k; j++) {
+        t->seg[j].index = -1;
+        for (i = 0; i < MAX_RISCV_PMPS; i++) {
+            if (pmp_get_a_field(t->pmp[i].cfg_reg) != PMP_AMATCH_OFF &&
+                t->seg[j].sa >= t->addr[i].sa &&
+                t->seg[j].sa <= t->addr[i].ea) {
+                t->seg[j].index = i;
+                break;
+            }
+        }
+    }
+
+    t->num_segs = k;
+    t->last_seg = 0;
+}
+
 void pmp_update_rule_nums(CPURISCVState *env)
 {
     int i;
@@ -200,6 +255,7 @@ void pmp_update_rule_nums(CPURISCVState *env)
             env->pmp_state.num_rules++;
         }
     }
+    pmp_update_rule_segs(env);
 }
 
 /* Convert cfg/addr reg values here into simple 'sa' --> start address and 'ea'
@@ -211,6 +267,8 @@ static void pmp_update_rule(CPURISCVState *env, uint32_t pmp_index)
 {
     pmp_update_rule_addr(env, pmp_index);
     pmp_update_rule_nums(env);
+    /* Page table loads cached in the page-walk cache skipped PMP checks */
+    riscv_cpu_pwc_flush(env);
 }
 
 static int pmp_is_in_range(CPURISCVState *env, int pmp_index, target_ulong addr)
@@ -283,6 +341,146 @@ static bool pmp_hart_has_privs_default(CPURISCVState *env, target_ulong addr,
 }
 
 
+/*
+ * Find the range that contains all of [sa, ea], trying the range of the
+ * previous lookup first.  Returns -1 if the addresses are in different
+ * ranges, in which case the caller has to check every entry.
+ */
+static int pmp_find_seg(CPURISCVState *env, target_ulong sa, target_ulong ea)
+{
+    pmp_table_t *t = &env->pmp_state;
+    int lo, hi, k;
+
+    if (t->num_segs == 0 || ea < sa) {
+        return -1;
+    }
+
+    k = t->last_seg;
+    if (!(t->seg[k].sa <= sa &&
+          (k + 1 == t->num_segs || sa < t->seg[k + 1].sa))) {
+        /* Binary search for the last range starting at or below sa */
+        lo = 0;
+        hi = t->num_segs - 1;
+        while (lo < hi) {
+            int mid = (lo + hi + 1) / 2;
+
+            if (t->seg[mid].sa <= sa) {
+                lo = mid;
+            } else {
+                hi = mid - 1;
+            }
+        }
+        k = lo;
+        t->last_seg = k;
+    }
+
+    if (k + 1 < t->num_segs && ea >= t->seg[k + 1].sa) {
+        return -1;
+    }
+    return k;
+}
+
+/*
+ * Privileges granted by PMP entry i to an access from the given mode
+ */
+static pmp_priv_t pmp_entry_privs(CPURISCVState *env, int i,
+                                  target_ulong mode)
+{
+    pmp_priv_t allowed_privs;
+
+    /*
+     * Convert the PMP permissions to match the truth table in the
+     * ePMP spec.
+     */
+    const uint8_t epmp_operation =
+        ((env->pmp_state.pmp[i].cfg_reg & PMP_LOCK) >> 4) |
+        ((env->pmp_state.pmp[i].cfg_reg & PMP_READ) << 2) |
+        (env->pmp_state.pmp[i].cfg_reg & PMP_WRITE) |
+        ((env->pmp_state.pmp[i].cfg_reg & PMP_EXEC) >> 2);
+
+    if (!MSECCFG_MML_ISSET(env)) {
+        /*
+         * If mseccfg.MML Bit is not set, do pmp priv check
+         * This will always apply to regular PMP.
+         */
+        allowed_privs = PMP_READ | PMP_WRITE | PMP_EXEC;
+        if ((mode != PRV_M) || pmp_is_locked(env, i)) {
+            allowed_privs &= env->pmp_state.pmp[i].cfg_reg;
+        }
+    } else {
+        /*
+         * If mseccfg.MML Bit set, do the enhanced pmp priv check
+         */
+        if (mode == PRV_M) {
+            switch (epmp_operation) {
+            case 0:
+            case 1:
+            case 4:
+            case 5:
+            case 6:
+            case 7:
+            case 8:
+                allowed_privs = 0;
+                break;
+            case 2:
+            case 3:
+            case 14:
+                allowed_privs = PMP_READ | PMP_WRITE;
+                break;
+            case 9:
+            case 10:
+                allowed_privs = PMP_EXEC;
+                break;
+            case 11:
+            case 13:
+                allowed_privs = PMP_READ | PMP_EXEC;
+                break;
+            case 12:
+            case 15:
+                allowed_privs = PMP_READ;
+                break;
+            default:
+                g_assert_not_reached();
+            }
+        } else {
+            switch (epmp_operation) {
+            case 0:
+            case 8:
+            case 9:
+            case 12:
+            case 13:
+            case 14:
+                allowed_privs = 0;
+                break;
+            case 1:
+            case 10:
+            case 11:
+                allowed_privs = PMP_EXEC;
+                break;
+            case 2:
+            case 4:
+            case 15:
+                allowed_privs = PMP_READ;
+                break;
+            case 3:
+            case 6:
+                allowed_privs = PMP_READ | PMP_WRITE;
+                break;
+            case 5:
+                allowed_privs = PMP_READ | PMP_EXEC;
+                break;
+            case 7:
+                allowed_privs = PMP_READ | PMP_WRITE | PMP_EXEC;
+                break;
+            default:
+                g_assert_not_reached();
+            }
+        }
+    }
+
+    return allowed_privs;
+}
+
 /*
  * Public Interface
  */
@@ -295,6 +493,7 @@ bool pmp_hart_has_privs(CPURISCVState *env, target_ulong addr,
     target_ulong mode)
 {
     int i = 0;
+    int seg;
     int ret = -1;
     int pmp_size = 0;
     target_ulong s = 0;
@@ -320,6 +519,18 @@ bool pmp_hart_has_privs(CPURISCVState *env, target_ulong addr,
         pmp_size = size;
     }
 
+    /* Common case: the whole access falls into one precomputed range */
+    seg = pmp_find_seg(env, addr, addr + pmp_size - 1);
+    if (seg >= 0) {
+        i = env->pmp_state.seg[seg].index;
+        if (i < 0) {
+            return pmp_hart_has_privs_default(env, addr, size, privs,
+                                              allowed_privs, mode);
+        }
+        *allowed_privs = pmp_entry_privs(env, i, mode);
+        return (privs & *allowed_privs) == privs;
+    }
+
     /* 1.10 draft priv spec states there is an implicit order
          from low to high */
     for (i = 0; i < MAX_RISCV_PMPS; i++) {
@@ -338,101 +549,12 @@ bool pmp_hart_has_privs(CPURISCVState *env, target_ulong addr,
         const uint8_t a_field =
             pmp_get_a_field(env->pmp_state.pmp[i].cfg_reg);
 
-        /*
-         * Convert the PMP permissions to match the truth table in the
-         * ePMP spec.
-         */
-        const uint8_t epmp_operation =
-            ((env->pmp_state.pmp[i].cfg_reg & PMP_LOCK) >> 4) |
-            ((env->pmp_state.pmp[i].cfg_reg & PMP_READ) << 2) |
-            (env->pmp_state.pmp[i].cfg_reg & PMP_WRITE) |
-            ((env->pmp_state.pmp[i].cfg_reg & PMP_EXEC) >> 2);
-
         if (((s + e) == 2) && (PMP_AMATCH_OFF != a_field)) {
             /*
              * If the PMP entry is not off and the address is in range,
              * do the priv check
              */
-            if (!MSECCFG_MML_ISSET(env)) {
-                /*
-                 * If mseccfg.MML Bit is not set, do pmp priv check
-                 * This will always apply to regular PMP.
-                 */
-                *allowed_privs = PMP_READ | PMP_WRITE | PMP_EXEC;
-                if ((mode != PRV_M) || pmp_is_locked(env, i)) {
-                    *allowed_privs &= env->pmp_state.pmp[i].cfg_reg;
-                }
-            } else {
-                /*
-                 * If mseccfg.MML Bit set, do the enhanced pmp priv check
-                 */
-                if (mode == PRV_M) {
-                    switch (epmp_operation) {
-                    case 0:
-                    case 1:
-                    case 4:
-                    case 5:
-                    case 6:
-                    case 7:
-                    case 8:
-                        *allowed_privs = 0;
-                        break;
-                    case 2:
-                    case 3:
-                    case 14:
-                        *allowed_privs = PMP_READ | PMP_WRITE;
-                        break;
-                    case 9:
-                    case 10:
-                        *allowed_privs = PMP_EXEC;
-                        break;
-                    case 11:
-                    case 13:
-                        *allowed_privs = PMP_READ | PMP_EXEC;
-                        break;
-                    case 12:
-                    case 15:
-                        *allowed_privs = PMP_READ;
-                        break;
-                    default:
-                        g_assert_not_reached();
-                    }
-                } else {
-                    switch (epmp_operation) {
-                    case 0:
-                    case 8:
-                    case 9:
-                    case 12:
-                    case 13:
-                    case 14:
-                        *allowed_privs = 0;
-                        break;
-                    case 1:
-                    case 10:
-                    case 11:
-                        *allowed_privs = PMP_EXEC;
-                        break;
-                    case 2:
-                    case 4:
-                    case 15:
-                        *allowed_privs = PMP_READ;
-                        break;
-                    case 3:
-                    case 6:
-                        *allowed_privs = PMP_READ | PMP_WRITE;
-                        break;
-                    case 5:
-                        *allowed_privs = PMP_READ | PMP_EXEC;
-                        break;
-                    case 7:
-                        *allowed_privs = PMP_READ | PMP_WRITE | PMP_EXEC;
-                        break;
-                    default:
-                        g_assert_not_reached();
-                    }
-                }
-            }
-
+            *allowed_privs = pmp_entry_privs(env, i, mode);
             ret = ((privs & *allowed_privs) == privs);
             break;
         }
@@ -615,6 +737,11 @@ bool pmp_is_range_in_tlb(CPURISCVState *env, hwaddr tlb_sa,
     target_ulong val;
     target_ulong tlb_ea = (tlb_sa + TARGET_PAGE_SIZE - 1);
 
+    /* No entry starts or ends inside the page, so it can use a full TLB entry */
+    if (pmp_find_seg(env, tlb_sa, tlb_ea) >= 0) {
+        return false;
+    }
+
     for (i = 0; i < MAX_RISCV_PMPS; i++) {
         val = pmp_get_tlb_size(env, i, tlb_sa, tlb_ea);
         if (val) {
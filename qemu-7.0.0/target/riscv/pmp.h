@@ -56,10 +56,23 @@ typedef struct {
     target_ulong ea;
 } pmp_addr_t;
 
+/*
+ * An address range in which every address is matched by the same PMP
+ * entry.  The range extends up to the start of the next one.
+ */
+typedef struct {
+    target_ulong sa;
+    int index;          /* matching entry, or -1 if none */
+} pmp_seg_t;
+
 typedef struct {
     pmp_entry_t pmp[MAX_RISCV_PMPS];
     pmp_addr_t  addr[MAX_RISCV_PMPS];
     uint32_t num_rules;
+    /* Ranges sorted by address, rebuilt by pmp_update_rule_nums() */
+    pmp_seg_t seg[2 * MAX_RISCV_PMPS + 1];
+    uint32_t num_segs;
+    uint32_t last_seg;
 } pmp_table_t;
 
 void pmpcfg_csr_write(CPURISCVState *env, uint32_t reg_index,
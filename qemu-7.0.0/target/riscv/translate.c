@@ -68,11 +68,13 @@ typedef struct DisasContext {
     uint32_t mstatus_hs_fs;
     uint32_t mstatus_hs_vs;
     uint32_t mem_idx;
+    /* Privilege level from the TB flags */
+    uint32_t priv;
     /* Remember the rounding mode encoded in the previous fp instruction,
        which we have already installed into env->fp_status.  Or -1 for
        no previous fp instruction.  Note that we exit the TB when writing
-       to any system register, which includes CSR_FRM, so we do not have
-       to reset this known value.  */
+       to any system register that may affect translation, which includes
+       CSR_FRM, so we do not have to reset this known value.  */
     int frm;
     RISCVMXL ol;
     bool virt_enabled;
@@ -260,6 +262,16 @@ static void gen_goto_tb(DisasContext *ctx, int n, target_ulong dest)
     }
 }
 
+/*
+ * Leave a tier-2 superblock before its end.  The goto_tb slots are kept
+ * for the final exit, so go through the TB lookup instead.
+ */
+static void gen_side_exit(DisasContext *ctx, target_ulong dest)
+{
+    gen_set_pc_imm(ctx, dest);
+    tcg_gen_lookup_and_goto_ptr();
+}
+
 /*
  * Wrappers for getting reg values.
  *
@@ -516,6 +528,32 @@ static void gen_set_fpr_d(DisasContext *ctx, int reg_num, TCGv_i64 t)
     }
 }
 
+/* x1 and x5 are the link registers of the calling convention */
+static bool is_link_reg(int reg)
+{
+    return reg == xRA || reg == 5;
+}
+
+/*
+ * TB flags the CPU will have at the end of the current instruction:
+ * the only state the translator changes without ending the TB is the
+ * FS/VS dirty marking.
+ */
+static uint32_t ctx_tb_flags(DisasContext *ctx)
+{
+    uint32_t flags = ctx->base.tb->flags;
+
+    flags &= ~(TB_FLAGS_MSTATUS_FS | TB_FLAGS_MSTATUS_VS);
+    flags |= ctx->mstatus_fs | ctx->mstatus_vs;
+    if (ctx->mstatus_hs_fs == MSTATUS_FS) {
+        flags = FIELD_DP32(flags, TB_FLAGS, MSTATUS_HS_FS, 3);
+    }
+    if (ctx->mstatus_hs_vs == MSTATUS_VS) {
+        flags = FIELD_DP32(flags, TB_FLAGS, MSTATUS_HS_VS, 3);
+    }
+    return flags;
+}
+
 static void gen_jal(DisasContext *ctx, int rd, target_ulong imm)
 {
     target_ulong next_pc;
@@ -530,6 +568,14 @@ static void gen_jal(DisasContext *ctx, int rd, target_ulong imm)
     }
 
     gen_set_gpri(ctx, rd, ctx->pc_succ_insn);
+    if (is_link_reg(rd)) {
+        translator_ras_push(&ctx->base, ctx->pc_succ_insn);
+    }
+    if (translator_follow(&ctx->base, next_pc)) {
+        /* tier-2 superblock: continue translating at the target */
+        ctx->pc_succ_insn = next_pc;
+        return;
+    }
     gen_goto_tb(ctx, 0, ctx->base.pc_next + imm); /* must use this for safety */
     ctx->base.is_jmp = DISAS_NORETURN;
 }
@@ -1080,6 +1126,7 @@ static void riscv_tr_init_disas_context(DisasContextBase *dcbase, CPUState *cs)
 
     ctx->pc_succ_insn = ctx->base.pc_first;
     ctx->mem_idx = FIELD_EX32(tb_flags, TB_FLAGS, MEM_IDX);
+    ctx->priv = FIELD_EX32(tb_flags, TB_FLAGS, PRIV);
     ctx->mstatus_fs = tb_flags & TB_FLAGS_MSTATUS_FS;
     ctx->mstatus_vs = tb_flags & TB_FLAGS_MSTATUS_VS;
     ctx->priv_ver = env->priv_ver;
@@ -2448,6 +2448,90 @@ GEN_VEXT_VX_RM(vssub_vx_h, 2)
 GEN_VEXT_VX_RM(vssub_vx_w, 4)
 GEN_VEXT_VX_RM(vssub_vx_d, 8)
 
+/*
+ * Out-of-line versions of the inline vsaddu/vsadd/vssubu/vssub
+ * expansions: @vsat gets a non-zero element wherever @vd saturated.
+ */
+#define GEN_VEC_SAT(NAME, ETYPE, OP)                                    \
+void HELPER(NAME)(void *vd, void *vsat, void *vs2, void *vs1,          \
+                  uint32_t desc)                                        \
+{                                                                       \
+    intptr_t oprsz = simd_oprsz(desc);                                  \
+    intptr_t i;                                                         \
+                                                                        \
+    for (i = 0; i < oprsz; i += sizeof(ETYPE)) {                        \
+        ETYPE a = *(ETYPE *)(vs2 + i);                                  \
+        ETYPE b = *(ETYPE *)(vs1 + i);                                  \
+        ETYPE res;                                                      \
+                                                                        \
+        OP;                                                             \
+        *(ETYPE *)(vd + i) = res;                                       \
+    }                                                                   \
+}
+
+#define SAT_ADDU(MAX)                                                   \
+    res = a + b;                                                        \
+    if (res < a) {                                                      \
+        res = MAX;                                                      \
+        *(typeof(res) *)(vsat + i) = -1;                                \
+    }
+
+#define SAT_ADD(MIN, MAX)                                               \
+    res = a + b;                                                        \
+    if ((res ^ a) & (res ^ b) & MIN) {                                  \
+        res = a > 0 ? MAX : MIN;                                        \
+        *(typeof(res) *)(vsat + i) = -1;                                \
+    }
+
+#define SAT_SUBU                                                        \
+    res = a - b;                                                        \
+    if (res > a) {                                                      \
+        res = 0;                                                        \
+        *(typeof(res) *)(vsat + i) = -1;                                \
+    }
+
+#define SAT_SUB(MIN, MAX)                                               \
+    res = a - b;                                                        \
+    if ((res ^ a) & (a ^ b) & MIN) {                                    \
+        res = a >= 0 ? MAX : MIN;                                       \
+        *(typeof(res) *)(vsat + i) = -1;                                \
+    }
+
+GEN_VEC_SAT(vec_saddu8, uint8_t, SAT_ADDU(UINT8_MAX))
+GEN_VEC_SAT(vec_saddu16, uint16_t, SAT_ADDU(UINT16_MAX))
+GEN_VEC_SAT(vec_saddu32, uint32_t, SAT_ADDU(UINT32_MAX))
+GEN_VEC_SAT(vec_saddu64, uint64_t, SAT_ADDU(UINT64_MAX))
+GEN_VEC_SAT(vec_sadd8, int8_t, SAT_ADD(INT8_MIN, INT8_MAX))
+GEN_VEC_SAT(vec_sadd16, int16_t, SAT_ADD(INT16_MIN, INT16_MAX))
+GEN_VEC_SAT(vec_sadd32, int32_t, SAT_ADD(INT32_MIN, INT32_MAX))
+GEN_VEC_SAT(vec_sadd64, int64_t, SAT_ADD(INT64_MIN, INT64_MAX))
+GEN_VEC_SAT(vec_ssubu8, uint8_t, SAT_SUBU)
+GEN_VEC_SAT(vec_ssubu16, uint16_t, SAT_SUBU)
+GEN_VEC_SAT(vec_ssubu32, uint32_t, SAT_SUBU)
+GEN_VEC_SAT(vec_ssubu64, uint64_t, SAT_SUBU)
+GEN_VEC_SAT(vec_ssub8, int8_t, SAT_SUB(INT8_MIN, INT8_MAX))
+GEN_VEC_SAT(vec_ssub16, int16_t, SAT_SUB(INT16_MIN, INT16_MAX))
+GEN_VEC_SAT(vec_ssub32, int32_t, SAT_SUB(INT32_MIN, INT32_MAX))
+GEN_VEC_SAT(vec_ssub64, int64_t, SAT_SUB(INT64_MIN, INT64_MAX))
+
+target_ulong riscv_cpu_get_vxsat(CPURISCVState *env)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(env->vxsat_vec); i++) {
+        if (env->vxsat_vec[i]) {
+            return 1;
+        }
+    }
+    return env->vxsat;
+}
+
+void riscv_cpu_set_vxsat(CPURISCVState *env, target_ulong val)
+{
+    memset(env->vxsat_vec, 0, sizeof(env->vxsat_vec));
+    env->vxsat = val;
+}
+
 /* Vector Single-Width Averaging Add and Subtract */
 static inline uint8_t get_round(int vxrm, uint64_t v, uint8_t shift)
 {
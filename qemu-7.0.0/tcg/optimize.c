@@ -44,12 +44,56 @@ typedef struct TempOptInfo {
     uint64_t val;
     uint64_t z_mask;  /* mask bit is 0 if and only if value bit is 0 */
     uint64_t s_mask;  /* a left-aligned mask of clrsb(value) bits. */
+    uint32_t gen;     /* incremented whenever the temp is written */
 } TempOptInfo;
 
+/*
+ * A field of CPUArchState accessed with ld/st relative to env, with the
+ * temp that holds its value (if known) and the last store to it that
+ * nothing has read yet (if any).
+ */
+typedef struct OptEnvSlot {
+    intptr_t ofs;
+    int size;               /* 0 if the slot is free */
+    TCGOpcode ld_opc;       /* the load that can be replaced by VAL */
+    TCGTemp *val;
+    uint32_t val_gen;
+    TCGOp *store;
+} OptEnvSlot;
+
+#define OPT_ENV_SLOTS   16
+
+/* A guest load whose result is still in DST, see fold_qemu_ld. */
+typedef struct OptGuestLoad {
+    TCGOpcode opc;          /* 0 if the entry is free */
+    MemOpIdx oi;
+    TCGTemp *addr, *dst;
+    uint32_t addr_gen, dst_gen;
+} OptGuestLoad;
+
+#define OPT_GUEST_LOADS 8
+
+/* A pure op whose output still holds its result, see fold_cse. */
+#define OPT_CSE_IARGS   4
+
+typedef struct OptCSESlot {
+    TCGOp *op;
+    uint32_t gen[1 + OPT_CSE_IARGS];
+} OptCSESlot;
+
+#define OPT_CSE_SLOTS   64
+
 typedef struct OptContext {
     TCGContext *tcg;
     TCGOp *prev_mb;
     TCGTempSet temps_used;
+    TCGTemp *env;
+
+    /* Memory state of the current basic block. */
+    OptEnvSlot env_slots[OPT_ENV_SLOTS];
+    OptGuestLoad guest_loads[OPT_GUEST_LOADS];
+    OptCSESlot cse[OPT_CSE_SLOTS];
+    unsigned env_next, guest_next;
 
     /* In flight values from optimization. */
     uint64_t a_mask;  /* mask bit is 0 iff value identical to first input */
@@ -136,6 +180,7 @@ static void reset_ts(TCGTemp *ts)
     ti->is_const = false;
     ti->z_mask = -1;
     ti->s_mask = 0;
+    ti->gen++;
 }
 
 static void reset_temp(TCGArg arg)
@@ -157,6 +202,7 @@ static void init_ts_info(OptContext *ctx, TCGTemp *ts)
     ti = ts->state_ptr;
     if (ti == NULL) {
         ti = tcg_malloc(sizeof(TempOptInfo));
+        ti->gen = 0;
         ts->state_ptr = ti;
     }
 
@@ -697,6 +743,9 @@ static void finish_folding(OptContext *ctx, TCGOp *op)
      */
     if (def->flags & TCG_OPF_BB_END) {
         memset(&ctx->temps_used, 0, sizeof(ctx->temps_used));
+        memset(ctx->env_slots, 0, sizeof(ctx->env_slots));
+        memset(ctx->guest_loads, 0, sizeof(ctx->guest_loads));
+        memset(ctx->cse, 0, sizeof(ctx->cse));
         ctx->prev_mb = NULL;
         return;
     }
@@ -716,6 +765,296 @@ static void finish_folding(OptContext *ctx, TCGOp *op)
     }
 }
 
+/*
+ * Memory optimizations, all within a basic block.
+ *
+ * Loads and stores relative to env are tracked per field: a load of a
+ * field whose value is known is replaced by a copy, and a store is
+ * removed when the field is stored again before anything could read it.
+ * Anything that could read env (helpers, ops that can raise an exception,
+ * loads through other pointers) makes pending stores live; anything that
+ * could write it forgets the known values.  Fields at negative offsets,
+ * such as icount_decr, are written by other threads and are not tracked.
+ *
+ * TCG_CALL_NO_READ_GLOBALS/NO_WRITE_GLOBALS only describe the fields
+ * backing TCG globals, which are never accessed with ld/st: any other
+ * field may still be read or written by a helper that receives env.
+ * Only TCG_CALL_NO_SIDE_EFFECTS promises that the helper writes nothing.
+ */
+
+static inline bool ts_is_valid(TCGTemp *ts, uint32_t gen)
+{
+    return ts_info(ts)->gen == gen;
+}
+
+static int tcg_ldst_size(TCGOpcode opc)
+{
+    switch (opc) {
+    CASE_OP_32_64(ld8s):
+    CASE_OP_32_64(ld8u):
+    CASE_OP_32_64(st8):
+        return 1;
+    CASE_OP_32_64(ld16s):
+    CASE_OP_32_64(ld16u):
+    CASE_OP_32_64(st16):
+        return 2;
+    case INDEX_op_ld_i32:
+    case INDEX_op_ld32s_i64:
+    case INDEX_op_ld32u_i64:
+    case INDEX_op_st_i32:
+    case INDEX_op_st32_i64:
+        return 4;
+    case INDEX_op_ld_i64:
+    case INDEX_op_st_i64:
+        return 8;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+/* Return true if @op accesses env at a trackable offset. */
+static bool ldst_is_env(OptContext *ctx, TCGOp *op)
+{
+    return arg_temp(op->args[1]) == ctx->env && (intptr_t)op->args[2] >= 0;
+}
+
+static bool env_slot_overlaps(OptEnvSlot *e, intptr_t ofs, int size)
+{
+    return e->size && e->ofs < ofs + size && ofs < e->ofs + e->size;
+}
+
+/* Something may read env: all pending stores must stay. */
+static void env_observe_all(OptContext *ctx)
+{
+    for (int i = 0; i < OPT_ENV_SLOTS; i++) {
+        ctx->env_slots[i].store = NULL;
+    }
+}
+
+/* Something may write env: forget everything. */
+static void env_clobber_all(OptContext *ctx)
+{
+    memset(ctx->env_slots, 0, sizeof(ctx->env_slots));
+}
+
+static void guest_loads_clobber(OptContext *ctx)
+{
+    memset(ctx->guest_loads, 0, sizeof(ctx->guest_loads));
+}
+
+static OptEnvSlot *env_slot_new(OptContext *ctx)
+{
+    OptEnvSlot *e;
+
+    for (int i = 0; i < OPT_ENV_SLOTS; i++) {
+        if (!ctx->env_slots[i].size) {
+            return &ctx->env_slots[i];
+        }
+    }
+    /* Evicting a slot merely keeps its pending store. */
+    e = &ctx->env_slots[ctx->env_next++ % OPT_ENV_SLOTS];
+    memset(e, 0, sizeof(*e));
+    return e;
+}
+
+static bool fold_env_ld(OptContext *ctx, TCGOp *op)
+{
+    intptr_t ofs = op->args[2];
+    int size = tcg_ldst_size(op->opc);
+
+    for (int i = 0; i < OPT_ENV_SLOTS; i++) {
+        OptEnvSlot *e = &ctx->env_slots[i];
+
+        if (e->size == size && e->ofs == ofs && e->ld_opc == op->opc &&
+            e->val && ts_is_valid(e->val, e->val_gen)) {
+            ctx->tcg->opt_stats.ld_forwarded++;
+            return tcg_opt_gen_mov(ctx, op, op->args[0], temp_arg(e->val));
+        }
+    }
+    for (int i = 0; i < OPT_ENV_SLOTS; i++) {
+        if (env_slot_overlaps(&ctx->env_slots[i], ofs, size)) {
+            ctx->env_slots[i].store = NULL;
+        }
+    }
+    return false;
+}
+
+/* Called once the output of the env load @op has been reset. */
+static void record_env_ld(OptContext *ctx, TCGOp *op)
+{
+    OptEnvSlot *e = env_slot_new(ctx);
+    TCGTemp *dst = arg_temp(op->args[0]);
+
+    e->ofs = op->args[2];
+    e->size = tcg_ldst_size(op->opc);
+    e->ld_opc = op->opc;
+    e->val = dst;
+    e->val_gen = ts_info(dst)->gen;
+}
+
+static bool fold_tcg_st(OptContext *ctx, TCGOp *op)
+{
+    intptr_t ofs = op->args[2];
+    int size = tcg_ldst_size(op->opc);
+    OptEnvSlot *e;
+
+    if (!ldst_is_env(ctx, op)) {
+        /* The pointer may well point into env. */
+        env_observe_all(ctx);
+        env_clobber_all(ctx);
+        return false;
+    }
+
+    for (int i = 0; i < OPT_ENV_SLOTS; i++) {
+        e = &ctx->env_slots[i];
+        if (!env_slot_overlaps(e, ofs, size)) {
+            continue;
+        }
+        if (e->store && ofs <= e->ofs && e->ofs + e->size <= ofs + size) {
+            tcg_op_remove(ctx->tcg, e->store);
+            ctx->tcg->opt_stats.st_dead++;
+        }
+        memset(e, 0, sizeof(*e));
+    }
+
+    e = env_slot_new(ctx);
+    e->ofs = ofs;
+    e->size = size;
+    e->store = op;
+    switch (op->opc) {
+    case INDEX_op_st_i32:
+        e->ld_opc = INDEX_op_ld_i32;
+        break;
+    case INDEX_op_st_i64:
+        e->ld_opc = INDEX_op_ld_i64;
+        break;
+    default:
+        /* A truncating store does not give the value of any load. */
+        return false;
+    }
+    e->val = arg_temp(op->args[0]);
+    e->val_gen = ts_info(e->val)->gen;
+    return false;
+}
+
+static bool fold_ld_vec(OptContext *ctx, TCGOp *op)
+{
+    env_observe_all(ctx);
+    return false;
+}
+
+static bool fold_st_vec(OptContext *ctx, TCGOp *op)
+{
+    env_observe_all(ctx);
+    env_clobber_all(ctx);
+    return false;
+}
+
+/*
+ * Common subexpression elimination of pure ops.  The slot remembers the
+ * first op computing a value, which can replace a later identical op as
+ * long as neither its inputs nor its output have been written since.
+ * Inputs are compared as temps after copy propagation, which already
+ * canonicalized copies and constants.
+ */
+static bool op_is_pure(TCGOp *op)
+{
+    const TCGOpDef *def = &tcg_op_defs[op->opc];
+
+    if (def->nb_oargs != 1 || def->nb_iargs > OPT_CSE_IARGS ||
+        (def->flags & (TCG_OPF_BB_END | TCG_OPF_CALL_CLOBBER |
+                       TCG_OPF_SIDE_EFFECTS | TCG_OPF_NOT_PRESENT))) {
+        return false;
+    }
+
+    switch (op->opc) {
+    CASE_OP_32_64_VEC(mov):
+    CASE_OP_32_64(ld8s):
+    CASE_OP_32_64(ld8u):
+    CASE_OP_32_64(ld16s):
+    CASE_OP_32_64(ld16u):
+    CASE_OP_32_64(ld):
+    case INDEX_op_ld32s_i64:
+    case INDEX_op_ld32u_i64:
+    case INDEX_op_ld_vec:
+    case INDEX_op_dupm_vec:
+        return false;
+    default:
+        return true;
+    }
+}
+
+static OptCSESlot *cse_slot(OptContext *ctx, TCGOp *op)
+{
+    const TCGOpDef *def = &tcg_op_defs[op->opc];
+    int nb_args = def->nb_iargs + def->nb_cargs;
+    uint64_t h = op->opc | (op->param1 << 8) | (op->param2 << 12);
+
+    for (int i = 1; i <= nb_args; i++) {
+        h = h * 31 + op->args[i];
+    }
+    h ^= h >> 17;
+    return &ctx->cse[(h ^ (h >> 31)) % OPT_CSE_SLOTS];
+}
+
+static bool fold_cse(OptContext *ctx, TCGOp *op)
+{
+    const TCGOpDef *def = &tcg_op_defs[op->opc];
+    int nb_args = def->nb_iargs + def->nb_cargs;
+    OptCSESlot *e;
+    TCGOp *prev;
+
+    if (!op_is_pure(op)) {
+        return false;
+    }
+
+    e = cse_slot(ctx, op);
+    prev = e->op;
+    if (!prev || prev->opc != op->opc ||
+        prev->param1 != op->param1 || prev->param2 != op->param2) {
+        return false;
+    }
+    for (int i = 1; i <= nb_args; i++) {
+        if (prev->args[i] != op->args[i]) {
+            return false;
+        }
+    }
+    if (!ts_is_valid(arg_temp(prev->args[0]), e->gen[0])) {
+        return false;
+    }
+    for (int i = 1; i <= def->nb_iargs; i++) {
+        if (!ts_is_valid(arg_temp(prev->args[i]), e->gen[i])) {
+            return false;
+        }
+    }
+
+    ctx->tcg->opt_stats.cse++;
+    return tcg_opt_gen_mov(ctx, op, op->args[0], prev->args[0]);
+}
+
+/* Called once the output of @op has been reset. */
+static void record_cse(OptContext *ctx, TCGOp *op)
+{
+    const TCGOpDef *def = &tcg_op_defs[op->opc];
+    OptCSESlot *e;
+
+    if (!op_is_pure(op)) {
+        return;
+    }
+    /* The inputs must still be there to compare against. */
+    for (int i = 1; i <= def->nb_iargs; i++) {
+        if (op->args[i] == op->args[0]) {
+            return;
+        }
+    }
+
+    e = cse_slot(ctx, op);
+    e->op = op;
+    for (int i = 0; i <= def->nb_iargs; i++) {
+        e->gen[i] = arg_info(op->args[i])->gen;
+    }
+}
+
 /*
  * The fold_* functions return true when processing is complete,
  * usually by folding the operation to a constant or to a copy,
@@ -1210,8 +1549,15 @@ static bool fold_call(OptContext *ctx, TCGOp *op)
     init_arguments(ctx, op, nb_oargs + nb_iargs);
     copy_propagate(ctx, op, nb_oargs, nb_iargs);
 
-    /* If the function reads or writes globals, reset temp data. */
+    /* Helpers may read env, and raise exceptions that do. */
     flags = tcg_call_flags(op);
+    env_observe_all(ctx);
+    if (!(flags & TCG_CALL_NO_SIDE_EFFECTS)) {
+        env_clobber_all(ctx);
+        guest_loads_clobber(ctx);
+    }
+
+    /* If the function reads or writes globals, reset temp data. */
     if (!(flags & (TCG_CALL_NO_READ_GLOBALS | TCG_CALL_NO_WRITE_GLOBALS))) {
         int nb_globals = s->nb_globals;
 
@@ -1478,6 +1824,9 @@ static bool fold_extu(OptContext *ctx, TCGOp *op)
 
 static bool fold_mb(OptContext *ctx, TCGOp *op)
 {
+    /* Guest loads after a barrier may see stores by other vCPUs. */
+    guest_loads_clobber(ctx);
+
     /* Eliminate duplicate and redundant fence instructions.  */
     if (ctx->prev_mb) {
         /*
@@ -1708,12 +2057,39 @@ static bool fold_orc(OptContext *ctx, TCGOp *op)
     return false;
 }
 
+/*
+ * In user mode, a guest load from the same address as an earlier one,
+ * with no store, barrier or helper call in between, returns the same
+ * value.  With softmmu the address could be MMIO, where each read may
+ * have side effects.  Guest loads may fault and thus expose env.
+ */
 static bool fold_qemu_ld(OptContext *ctx, TCGOp *op)
 {
     const TCGOpDef *def = &tcg_op_defs[op->opc];
     MemOpIdx oi = op->args[def->nb_oargs + def->nb_iargs];
     MemOp mop = get_memop(oi);
     int width = 8 * memop_size(mop);
+#ifdef CONFIG_USER_ONLY
+    bool track = def->nb_oargs == 1 && def->nb_iargs == 1;
+    TCGTemp *addr = arg_temp(op->args[1]);
+    OptGuestLoad *g;
+    int i;
+
+    for (i = 0; track && i < OPT_GUEST_LOADS; i++) {
+        g = &ctx->guest_loads[i];
+        if (g->opc == op->opc && g->oi == oi &&
+            ts_are_copies(g->addr, addr) &&
+            ts_is_valid(g->addr, g->addr_gen) &&
+            ts_is_valid(g->dst, g->dst_gen)) {
+            ctx->tcg->opt_stats.qemu_ld_cse++;
+            return tcg_opt_gen_mov(ctx, op, op->args[0], temp_arg(g->dst));
+        }
+    }
+#else
+    /* MMIO callbacks may change the CPU state. */
+    env_clobber_all(ctx);
+#endif
+    env_observe_all(ctx);
 
     if (width < 64) {
         ctx->s_mask = MAKE_64BIT_MASK(width, 64 - width);
@@ -1725,11 +2101,35 @@ static bool fold_qemu_ld(OptContext *ctx, TCGOp *op)
 
     /* Opcodes that touch guest memory stop the mb optimization.  */
     ctx->prev_mb = NULL;
+
+#ifdef CONFIG_USER_ONLY
+    if (track) {
+        finish_folding(ctx, op);
+        g = &ctx->guest_loads[ctx->guest_next++ % OPT_GUEST_LOADS];
+        g->opc = op->opc;
+        g->oi = oi;
+        g->addr = addr;
+        g->addr_gen = ts_info(addr)->gen;
+        g->dst = arg_temp(op->args[0]);
+        g->dst_gen = ts_info(g->dst)->gen;
+        /* The address was overwritten by the load itself. */
+        if (g->dst == addr) {
+            g->opc = 0;
+        }
+        return true;
+    }
+#endif
     return false;
 }
 
 static bool fold_qemu_st(OptContext *ctx, TCGOp *op)
 {
+    env_observe_all(ctx);
+#ifndef CONFIG_USER_ONLY
+    env_clobber_all(ctx);
+#endif
+    guest_loads_clobber(ctx);
+
     /* Opcodes that touch guest memory stop the mb optimization.  */
     ctx->prev_mb = NULL;
     return false;
@@ -1977,7 +2377,16 @@ static bool fold_sub2(OptContext *ctx, TCGOp *op)
 
 static bool fold_tcg_ld(OptContext *ctx, TCGOp *op)
 {
-    /* We can't do any folding with a load, but we can record bits. */
+    bool env = ldst_is_env(ctx, op);
+
+    if (!env) {
+        /* The pointer may well point into env. */
+        env_observe_all(ctx);
+    } else if (fold_env_ld(ctx, op)) {
+        return true;
+    }
+
+    /* Otherwise we can't do any folding with a load, but can record bits. */
     switch (op->opc) {
     CASE_OP_32_64(ld8s):
         ctx->s_mask = MAKE_64BIT_MASK(8, 56);
@@ -2000,9 +2409,17 @@ static bool fold_tcg_ld(OptContext *ctx, TCGOp *op)
         ctx->z_mask = MAKE_64BIT_MASK(0, 32);
         ctx->s_mask = MAKE_64BIT_MASK(33, 31);
         break;
+    CASE_OP_32_64(ld):
+        break;
     default:
         g_assert_not_reached();
     }
+
+    if (env) {
+        finish_folding(ctx, op);
+        record_env_ld(ctx, op);
+        return true;
+    }
     return false;
 }
 
@@ -2027,7 +2444,7 @@ void tcg_optimize(TCGContext *s)
 {
     int nb_temps, i;
     TCGOp *op, *op_next;
-    OptContext ctx = { .tcg = s };
+    OptContext ctx = { .tcg = s, .env = tcgv_ptr_temp(cpu_env) };
 
     /* Array VALS has an element for each temp.
        If this temp holds a constant then its value is kept in VALS' element.
@@ -2038,6 +2455,7 @@ void tcg_optimize(TCGContext *s)
     for (i = 0; i < nb_temps; ++i) {
         s->temps[i].state_ptr = NULL;
     }
+    memset(&s->opt_stats, 0, sizeof(s->opt_stats));
 
     QTAILQ_FOREACH_SAFE(op, &s->ops, link, op_next) {
         TCGOpcode opc = op->opc;
@@ -2146,10 +2564,15 @@ void tcg_optimize(TCGContext *s)
         CASE_OP_32_64(ld8u):
         CASE_OP_32_64(ld16s):
         CASE_OP_32_64(ld16u):
+        CASE_OP_32_64(ld):
         case INDEX_op_ld32s_i64:
         case INDEX_op_ld32u_i64:
             done = fold_tcg_ld(&ctx, op);
             break;
+        case INDEX_op_ld_vec:
+        case INDEX_op_dupm_vec:
+            done = fold_ld_vec(&ctx, op);
+            break;
         case INDEX_op_mb:
             done = fold_mb(&ctx, op);
             break;
@@ -2217,6 +2640,15 @@ void tcg_optimize(TCGContext *s)
         CASE_OP_32_64(sextract):
             done = fold_sextract(&ctx, op);
             break;
+        CASE_OP_32_64(st8):
+        CASE_OP_32_64(st16):
+        CASE_OP_32_64(st):
+        case INDEX_op_st32_i64:
+            done = fold_tcg_st(&ctx, op);
+            break;
+        case INDEX_op_st_vec:
+            done = fold_st_vec(&ctx, op);
+            break;
         CASE_OP_32_64(sub):
             done = fold_sub(&ctx, op);
             break;
@@ -2233,8 +2665,12 @@ void tcg_optimize(TCGContext *s)
             break;
         }
 
+        if (!done) {
+            done = fold_cse(&ctx, op);
+        }
         if (!done) {
             finish_folding(&ctx, op);
+            record_cse(&ctx, op);
         }
     }
 }
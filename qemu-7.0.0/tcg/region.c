@@ -28,6 +28,7 @@
 #include "qemu/mprotect.h"
 #include "qemu/memalign.h"
 #include "qemu/cacheinfo.h"
+#include "qemu/bitmap.h"
 #include "qapi/error.h"
 #include "exec/exec-all.h"
 #include "tcg/tcg.h"
@@ -60,6 +61,9 @@ struct tcg_region_state {
     /* fields protected by the lock */
     size_t current; /* current region index */
     size_t agg_size_full; /* aggregate size of full regions */
+    uint64_t alloc_seq; /* number of region assignments so far */
+    uint64_t *age; /* alloc_seq when each region was assigned, 0 if free */
+    unsigned long *evicted; /* regions freed by tcg_region_evict() */
 };
 
 static struct tcg_region_state region;
@@ -167,10 +171,23 @@ static void tcg_region_trees_init(void)
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+/* @p must be in the rw view of code_gen_buffer */
+static size_t tcg_region_index(const void *p)
 {
-    size_t region_idx;
+    ptrdiff_t offset;
+
+    if (p < region.start_aligned) {
+        return 0;
+    }
+    offset = p - region.start_aligned;
+    if (offset > region.stride * (region.n - 1)) {
+        return region.n - 1;
+    }
+    return offset / region.stride;
+}
 
+static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+{
     /*
      * Like tcg_splitwx_to_rw, with no assert.  The pc may come from
      * a signal handler over which the caller has no control.
@@ -182,18 +199,7 @@ static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
         }
     }
 
-    if (p < region.start_aligned) {
-        region_idx = 0;
-    } else {
-        ptrdiff_t offset = p - region.start_aligned;
-
-        if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
-        } else {
-            region_idx = offset / region.stride;
-        }
-    }
-    return region_trees + region_idx * tree_size;
+    return region_trees + tcg_region_index(p) * tree_size;
 }
 
 void tcg_tb_insert(TranslationBlock *tb)
@@ -335,11 +341,19 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
 
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
-    if (region.current == region.n) {
-        return true;
+    size_t i;
+
+    if (region.current < region.n) {
+        i = region.current++;
+    } else {
+        i = find_first_bit(region.evicted, region.n);
+        if (i == region.n) {
+            return true;
+        }
+        clear_bit(i, region.evicted);
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
+    tcg_region_assign(s, i);
+    region.age[i] = ++region.alloc_seq;
     return false;
 }
 
@@ -388,6 +402,8 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    memset(region.age, 0, region.n * sizeof(*region.age));
+    bitmap_zero(region.evicted, region.n);
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = qatomic_read(&tcg_ctxs[i]);
@@ -398,6 +414,101 @@ void tcg_region_reset_all(void)
     tcg_region_tree_reset_all();
 }
 
+/* Return true if tcg_region_alloc() can succeed without an eviction. */
+bool tcg_region_available(void)
+{
+    bool ret;
+
+    qemu_mutex_lock(&region.lock);
+    ret = region.current < region.n ||
+          find_first_bit(region.evicted, region.n) < region.n;
+    qemu_mutex_unlock(&region.lock);
+    return ret;
+}
+
+static gboolean tcg_region_collect_tb(gpointer key, gpointer value,
+                                      gpointer data)
+{
+    g_ptr_array_add(data, value);
+    return FALSE;
+}
+
+/*
+ * Call from a safe-work context.  Free the oldest quarter of the regions
+ * that no TCG context is currently translating into, so that code in
+ * younger regions survives.  @evict is called on every TB of those
+ * regions first and must unlink it from everything but the region tree.
+ * Returns the number of regions freed; 0 means that a full flush is
+ * needed instead.
+ */
+size_t tcg_region_evict(void (*evict)(TranslationBlock *tb))
+{
+    unsigned int n_ctxs = qatomic_read(&tcg_cur_ctxs);
+    size_t max = MAX(region.n / 4, 1);
+    g_autofree size_t *victims = g_new(size_t, max);
+    g_autofree uint64_t *busy_age = g_new(uint64_t, n_ctxs);
+    size_t nr = 0, i, j;
+
+    qemu_mutex_lock(&region.lock);
+    /* The regions being filled are busy; hide them by clearing their age */
+    for (j = 0; j < n_ctxs; j++) {
+        const TCGContext *s = qatomic_read(&tcg_ctxs[j]);
+
+        i = tcg_region_index(s->code_gen_buffer);
+        busy_age[j] = region.age[i];
+        region.age[i] = 0;
+    }
+    while (nr < max) {
+        size_t oldest = region.n;
+
+        for (i = 0; i < region.n; i++) {
+            if (region.age[i] &&
+                (oldest == region.n || region.age[i] < region.age[oldest])) {
+                oldest = i;
+            }
+        }
+        if (oldest == region.n) {
+            break;
+        }
+        region.age[oldest] = 0;
+        victims[nr++] = oldest;
+    }
+    for (j = 0; j < n_ctxs; j++) {
+        const TCGContext *s = qatomic_read(&tcg_ctxs[j]);
+
+        region.age[tcg_region_index(s->code_gen_buffer)] = busy_age[j];
+    }
+    qemu_mutex_unlock(&region.lock);
+
+    for (j = 0; j < nr; j++) {
+        struct tcg_region_tree *rt = region_trees + victims[j] * tree_size;
+        GPtrArray *tbs = g_ptr_array_new();
+        void *start, *end;
+
+        qemu_mutex_lock(&rt->lock);
+        g_tree_foreach(rt->tree, tcg_region_collect_tb, tbs);
+        qemu_mutex_unlock(&rt->lock);
+
+        for (i = 0; i < tbs->len; i++) {
+            evict(g_ptr_array_index(tbs, i));
+        }
+        g_ptr_array_free(tbs, true);
+
+        qemu_mutex_lock(&rt->lock);
+        /* Increment the refcount first so that destroy acts as a reset */
+        g_tree_ref(rt->tree);
+        g_tree_destroy(rt->tree);
+        qemu_mutex_unlock(&rt->lock);
+
+        tcg_region_bounds(victims[j], &start, &end);
+        qemu_mutex_lock(&region.lock);
+        region.agg_size_full -= end - start - TCG_HIGHWATER;
+        set_bit(victims[j], region.evicted);
+        qemu_mutex_unlock(&region.lock);
+    }
+    return nr;
+}
+
 static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus)
 {
 #ifdef CONFIG_USER_ONLY
@@ -411,9 +522,14 @@ static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus)
      * being of reasonable size. If that's not possible we make do by evenly
      * dividing the code_gen_buffer among the vCPUs.
      */
-    /* Use a single region if all we have is one vCPU thread */
+    /*
+     * A single vCPU thread only needs one region at a time, but a few
+     * >= 2 MB regions let tcg_region_evict() reclaim part of the buffer
+     * instead of flushing all of it.
+     */
     if (max_cpus == 1 || !qemu_tcg_mttcg_enabled()) {
-        return 1;
+        n_regions = tb_size / (2 * MiB);
+        return MAX(MIN(n_regions, 8), 1);
     }
 
     /*
@@ -786,6 +902,8 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
 
     /* init the region struct */
     qemu_mutex_init(&region.lock);
+    region.age = g_new0(uint64_t, region.n);
+    region.evicted = bitmap_new(region.n);
 
     /*
      * Set guard pages in the rw buffer, as that's the one into which
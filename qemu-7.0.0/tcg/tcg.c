@@ -32,6 +32,7 @@
 
 #include "qemu/error-report.h"
 #include "qemu/cutils.h"
+#include "qemu/bitmap.h"
 #include "qemu/host-utils.h"
 #include "qemu/qemu-print.h"
 #include "qemu/timer.h"
@@ -167,6 +168,7 @@ TCGContext **tcg_ctxs;
 unsigned int tcg_cur_ctxs;
 unsigned int tcg_max_ctxs;
 TCGv_env cpu_env = 0;
+bool tcg_carry_globals;
 const void *tcg_code_gen_epilogue;
 uintptr_t tcg_splitwx_diff;
 
@@ -1699,6 +1701,15 @@ static void tcg_reg_alloc_start(TCGContext *s)
     }
 
     memset(s->reg_to_temp, 0, sizeof(s->reg_to_temp));
+
+    if (tcg_carry_globals) {
+        TCGLabel *l;
+
+        QSIMPLEQ_FOREACH(l, &s->labels, next) {
+            l->carry_preds = 0;
+            l->carry_regs = NULL;
+        }
+    }
 }
 
 static char *tcg_get_arg_str_ptr(TCGContext *s, char *buf, int buf_size,
@@ -2401,6 +2412,63 @@ static void la_bb_end(TCGContext *s, int ng, int nt)
     }
 }
 
+/*
+ * liveness analysis: label with tcg_carry_globals.  As la_bb_end, except
+ * that direct globals are only synced: the register allocator may keep
+ * those live after the label in the register all predecessors agree on.
+ * Remember which ones are live for it.
+ */
+static void la_bb_label(TCGContext *s, TCGLabel *l, int ng, int nt)
+{
+    int i;
+
+    l->live_globals = tcg_malloc(BITS_TO_LONGS(ng) * sizeof(unsigned long));
+    bitmap_zero(l->live_globals, ng);
+
+    for (i = 0; i < ng; ++i) {
+        TCGTemp *ts = &s->temps[i];
+        int state = ts->state;
+
+        if (ts->kind != TEMP_GLOBAL || ts->indirect_reg) {
+            ts->state = TS_DEAD | TS_MEM;
+            la_reset_pref(ts);
+            continue;
+        }
+        ts->state = state | TS_MEM;
+        if (state & TS_DEAD) {
+            la_reset_pref(ts);
+        } else {
+            set_bit(i, l->live_globals);
+        }
+    }
+    for (i = ng; i < nt; ++i) {
+        TCGTemp *ts = &s->temps[i];
+
+        ts->state = ts->kind == TEMP_LOCAL ? TS_DEAD | TS_MEM : TS_DEAD;
+        la_reset_pref(ts);
+    }
+}
+
+/*
+ * liveness analysis: br with tcg_carry_globals.  As la_bb_end, except
+ * that the globals live after the target label, which was visited first
+ * unless the branch is backward, are only synced so that they may stay
+ * in their register across the branch.
+ */
+static void la_bb_branch(TCGContext *s, TCGLabel *l, int ng, int nt)
+{
+    int i;
+
+    la_bb_end(s, ng, nt);
+    if (l->live_globals) {
+        for (i = 0; i < ng; i++) {
+            if (test_bit(i, l->live_globals)) {
+                s->temps[i].state = TS_MEM;
+            }
+        }
+    }
+}
+
 /* liveness analysis: sync globals back to memory.  */
 static void la_global_sync(TCGContext *s, int ng)
 {
@@ -2499,6 +2567,15 @@ static void liveness_pass_1(TCGContext *s)
         s->temps[i].state_ptr = prefs + i;
     }
 
+    if (tcg_carry_globals) {
+        TCGLabel *l;
+
+        /* Drop the live sets of a previous pass, see la_bb_branch() */
+        QSIMPLEQ_FOREACH(l, &s->labels, next) {
+            l->live_globals = NULL;
+        }
+    }
+
     /* ??? Should be redundant with the exit_tb that ends the TB.  */
     la_func_end(s, nb_globals, nb_temps);
 
@@ -2728,6 +2805,10 @@ static void liveness_pass_1(TCGContext *s)
                 la_func_end(s, nb_globals, nb_temps);
             } else if (def->flags & TCG_OPF_COND_BRANCH) {
                 la_bb_sync(s, nb_globals, nb_temps);
+            } else if (opc == INDEX_op_set_label && tcg_carry_globals) {
+                la_bb_label(s, arg_label(op->args[0]), nb_globals, nb_temps);
+            } else if (opc == INDEX_op_br && tcg_carry_globals) {
+                la_bb_branch(s, arg_label(op->args[0]), nb_globals, nb_temps);
             } else if (def->flags & TCG_OPF_BB_END) {
                 la_bb_end(s, nb_globals, nb_temps);
             } else if (def->flags & TCG_OPF_SIDE_EFFECTS) {
@@ -3154,6 +3235,9 @@ static void temp_sync(TCGContext *s, TCGTemp *ts, TCGRegSet allocated_regs,
         if (!ts->mem_allocated) {
             temp_allocate_frame(s, ts);
         }
+        if (ts->kind == TEMP_GLOBAL && ts->val_type != TEMP_VAL_MEM) {
+            s->ra_stats.global_stores++;
+        }
         switch (ts->val_type) {
         case TEMP_VAL_CONST:
             /* If we're going to free the temp immediately, then we won't
@@ -3309,6 +3393,9 @@ static void temp_load(TCGContext *s, TCGTemp *ts, TCGRegSet desired_regs,
                             preferred_regs, ts->indirect_base);
         tcg_out_ld(s, ts->type, reg, ts->mem_base->reg, ts->mem_offset);
         ts->mem_coherent = 1;
+        if (ts->kind == TEMP_GLOBAL) {
+            s->ra_stats.global_loads++;
+        }
         break;
     case TEMP_VAL_DEAD:
     default:
@@ -3356,8 +3443,8 @@ static void sync_globals(TCGContext *s, TCGRegSet allocated_regs)
 }
 
 /* at the end of a basic block, we assume all temporaries are dead and
-   all globals are stored at their canonical location. */
-static void tcg_reg_alloc_bb_end(TCGContext *s, TCGRegSet allocated_regs)
+   local temps are stored at their canonical location. */
+static void temps_bb_end(TCGContext *s, TCGRegSet allocated_regs)
 {
     int i;
 
@@ -3382,10 +3469,97 @@ static void tcg_reg_alloc_bb_end(TCGContext *s, TCGRegSet allocated_regs)
             g_assert_not_reached();
         }
     }
+}
 
+/* at the end of a basic block, we assume all temporaries are dead and
+   all globals are stored at their canonical location. */
+static void tcg_reg_alloc_bb_end(TCGContext *s, TCGRegSet allocated_regs)
+{
+    temps_bb_end(s, allocated_regs);
     save_globals(s, allocated_regs);
 }
 
+/*
+ * With tcg_carry_globals, record which register holds each global at a
+ * branch to @l.  Globals held in different registers by different
+ * branches, or in none, will be in memory at the label.
+ */
+static void tcg_reg_alloc_branch(TCGContext *s, TCGLabel *l)
+{
+    int i, n = s->nb_globals;
+
+    if (!tcg_carry_globals) {
+        return;
+    }
+    if (l->carry_preds == 0) {
+        l->carry_regs = tcg_malloc(n);
+    }
+    for (i = 0; i < n; i++) {
+        TCGTemp *ts = &s->temps[i];
+        int reg = ts->val_type == TEMP_VAL_REG ? ts->reg : -1;
+
+        if (l->carry_preds == 0) {
+            l->carry_regs[i] = reg;
+        } else if (l->carry_regs[i] != reg) {
+            l->carry_regs[i] = -1;
+        }
+    }
+    l->carry_preds++;
+}
+
+/*
+ * At a label, all temporaries are dead and globals are in memory.  With
+ * tcg_carry_globals, a global that is live after the label stays in a
+ * register instead if every branch to the label, and the fall through
+ * path if any, has it synced in that register.  This is only possible
+ * once all the branches have been allocated, i.e. not for the targets
+ * of backward branches.
+ */
+static void tcg_reg_alloc_label(TCGContext *s, TCGLabel *l, bool fallthrough)
+{
+    int i, n = s->nb_globals;
+    bool carry;
+
+    if (!tcg_carry_globals) {
+        tcg_reg_alloc_bb_end(s, s->reserved_regs);
+        return;
+    }
+
+    temps_bb_end(s, s->reserved_regs);
+    carry = l->carry_preds == l->refs && (fallthrough || l->carry_preds);
+
+    for (i = 0; i < n; i++) {
+        TCGTemp *ts = &s->temps[i];
+        int reg = -1;
+
+        if (ts->kind == TEMP_FIXED) {
+            continue;
+        }
+        if (ts->val_type == TEMP_VAL_REG) {
+            /* The liveness analysis already ensures that globals are synced */
+            tcg_debug_assert(fallthrough && ts->mem_coherent);
+            s->reg_to_temp[ts->reg] = NULL;
+            reg = ts->reg;
+        }
+        if (!fallthrough) {
+            reg = l->carry_regs ? l->carry_regs[i] : -1;
+        } else if (l->carry_preds && l->carry_regs[i] != reg) {
+            reg = -1;
+        }
+
+        if (carry && reg >= 0 && l->live_globals
+            && test_bit(i, l->live_globals)) {
+            ts->val_type = TEMP_VAL_REG;
+            ts->reg = reg;
+            ts->mem_coherent = 1;
+            s->reg_to_temp[reg] = ts;
+            s->ra_stats.label_carries++;
+        } else {
+            ts->val_type = TEMP_VAL_MEM;
+        }
+    }
+}
+
 /*
  * At a conditional branch, we assume all temporaries are dead unless
  * explicitly live-across-conditional-branch; all globals and local
@@ -3759,6 +3933,17 @@ static void tcg_reg_alloc_op(TCGContext *s, const TCGOp *op)
 
     if (def->flags & TCG_OPF_COND_BRANCH) {
         tcg_reg_alloc_cbranch(s, i_allocated_regs);
+        tcg_reg_alloc_branch(s, arg_label(op->args[def->nb_iargs +
+                                                  def->nb_cargs - 1]));
+    } else if (op->opc == INDEX_op_br && tcg_carry_globals) {
+        /*
+         * The liveness analysis synced the globals live at the label, see
+         * la_bb_branch(); record their registers before releasing them.
+         */
+        temps_bb_end(s, i_allocated_regs);
+        sync_globals(s, i_allocated_regs);
+        tcg_reg_alloc_branch(s, arg_label(op->args[0]));
+        save_globals(s, i_allocated_regs);
     } else if (def->flags & TCG_OPF_BB_END) {
         tcg_reg_alloc_bb_end(s, i_allocated_regs);
     } else {
@@ -4187,6 +4372,21 @@ int64_t tcg_cpu_exec_time(void)
 }
 #endif
 
+void tcg_regalloc_stats(TCGRegAllocStats *stats)
+{
+    unsigned int n_ctxs = qatomic_read(&tcg_cur_ctxs);
+    unsigned int i;
+
+    memset(stats, 0, sizeof(*stats));
+    for (i = 0; i < n_ctxs; i++) {
+        const TCGContext *s = qatomic_read(&tcg_ctxs[i]);
+
+        stats->tbs += qatomic_read(&s->ra_stats.tbs);
+        stats->global_loads += qatomic_read(&s->ra_stats.global_loads);
+        stats->global_stores += qatomic_read(&s->ra_stats.global_stores);
+        stats->label_carries += qatomic_read(&s->ra_stats.label_carries);
+    }
+}
 
 int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
 {
@@ -4194,6 +4394,7 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
     TCGProfile *prof = &s->prof;
 #endif
     int i, num_insns;
+    int nb_ops_in, nb_ops_opt;
     TCGOp *op;
 
 #ifdef CONFIG_PROFILER
@@ -4250,9 +4451,11 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
     qatomic_set(&prof->opt_time, prof->opt_time - profile_getclock());
 #endif
 
+    nb_ops_in = s->nb_ops;
 #ifdef USE_TCG_OPTIMIZATIONS
     tcg_optimize(s);
 #endif
+    nb_ops_opt = s->nb_ops;
 
 #ifdef CONFIG_PROFILER
     qatomic_set(&prof->opt_time, prof->opt_time + profile_getclock());
@@ -4294,12 +4497,21 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
             fprintf(logfile, "OP after optimization and liveness analysis:\n");
             tcg_dump_ops(s, logfile, true);
             fprintf(logfile, "\n");
+            fprintf(logfile, "OP count %d, %d after optimization, "
+                    "%d after liveness analysis\n",
+                    nb_ops_in, nb_ops_opt, s->nb_ops);
+            fprintf(logfile, "OP optimization: %d env loads forwarded, "
+                    "%d dead env stores, %d common subexpressions, "
+                    "%d guest loads reused\n\n",
+                    s->opt_stats.ld_forwarded, s->opt_stats.st_dead,
+                    s->opt_stats.cse, s->opt_stats.qemu_ld_cse);
             qemu_log_unlock(logfile);
         }
     }
 #endif
 
     tcg_reg_alloc_start(s);
+    s->ra_stats.tbs++;
 
     /*
      * Reset the buffer pointers when restarting after overflow.
@@ -4355,7 +4567,13 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
             temp_dead(s, arg_temp(op->args[0]));
             break;
         case INDEX_op_set_label:
-            tcg_reg_alloc_bb_end(s, s->reserved_regs);
+            {
+                TCGOp *prev = QTAILQ_PREV(op, link);
+                bool fallthrough = prev && prev->opc != INDEX_op_br &&
+                    !(tcg_op_defs[prev->opc].flags & TCG_OPF_BB_EXIT);
+
+                tcg_reg_alloc_label(s, arg_label(op->args[0]), fallthrough);
+            }
             tcg_out_label(s, arg_label(op->args[0]));
             break;
         case INDEX_op_call:
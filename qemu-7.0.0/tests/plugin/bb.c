@@ -23,9 +23,19 @@ typedef struct {
     uint64_t insn_count;
 } CPUCount;
 
-/* Used by the inline & linux-user counts */
+/* Per-vCPU inline counts, summed up at exit */
+typedef struct {
+    uint64_t bb_count;
+    uint64_t insn_count;
+} InlineCount;
+
 static bool do_inline;
-static CPUCount inline_count;
+static struct qemu_plugin_scoreboard *inline_counts;
+static qemu_plugin_u64 inline_bb_count;
+static qemu_plugin_u64 inline_insn_count;
+
+/* Used by the linux-user callback count */
+static CPUCount user_count;
 
 /* Dump running CPU total on idle? */
 static bool idle_report;
@@ -46,9 +56,13 @@ static void plugin_exit(qemu_plugin_id_t id, void *p)
 {
     g_autoptr(GString) report = g_string_new("");
 
-    if (do_inline || !max_cpus) {
+    if (do_inline) {
         g_string_printf(report, "bb's: %" PRIu64", insns: %" PRIu64 "\n",
-                        inline_count.bb_count, inline_count.insn_count);
+                        qemu_plugin_u64_sum(inline_bb_count),
+                        qemu_plugin_u64_sum(inline_insn_count));
+    } else if (!max_cpus) {
+        g_string_printf(report, "bb's: %" PRIu64", insns: %" PRIu64 "\n",
+                        user_count.bb_count, user_count.insn_count);
     } else {
         g_ptr_array_foreach(counts, (GFunc) gen_one_cpu_report, report);
     }
@@ -70,7 +84,7 @@ static void vcpu_idle(qemu_plugin_id_t id, unsigned int cpu_index)
 static void vcpu_tb_exec(unsigned int cpu_index, void *udata)
 {
     CPUCount *count = max_cpus ?
-        g_ptr_array_index(counts, cpu_index) : &inline_count;
+        g_ptr_array_index(counts, cpu_index) : &user_count;
 
     uintptr_t n_insns = (uintptr_t)udata;
     g_mutex_lock(&count->lock);
@@ -84,11 +98,10 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
     size_t n_insns = qemu_plugin_tb_n_insns(tb);
 
     if (do_inline) {
-        qemu_plugin_register_vcpu_tb_exec_inline(tb, QEMU_PLUGIN_INLINE_ADD_U64,
-                                                 &inline_count.bb_count, 1);
-        qemu_plugin_register_vcpu_tb_exec_inline(tb, QEMU_PLUGIN_INLINE_ADD_U64,
-                                                 &inline_count.insn_count,
-                                                 n_insns);
+        qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+            tb, QEMU_PLUGIN_INLINE_ADD_U64, inline_bb_count, 1);
+        qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+            tb, QEMU_PLUGIN_INLINE_ADD_U64, inline_insn_count, n_insns);
     } else {
         qemu_plugin_register_vcpu_tb_exec_cb(tb, vcpu_tb_exec,
                                              QEMU_PLUGIN_CB_NO_REGS,
@@ -131,7 +144,13 @@ QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
             g_ptr_array_add(counts, count);
         }
     } else if (!do_inline) {
-        g_mutex_init(&inline_count.lock);
+        g_mutex_init(&user_count.lock);
+    } else {
+        inline_counts = qemu_plugin_scoreboard_new(sizeof(InlineCount));
+        inline_bb_count = qemu_plugin_scoreboard_u64_in_struct(
+            inline_counts, InlineCount, bb_count);
+        inline_insn_count = qemu_plugin_scoreboard_u64_in_struct(
+            inline_counts, InlineCount, insn_count);
     }
 
     if (idle_report) {
@@ -0,0 +1,83 @@
+/*
+ * QTest testcase for the x-pc-profile-start/stop QMP commands
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+
+#define DRAM_BASE       0x80000000
+
+/*
+ * Point s0 at the UART of the virt board, then spin: the frame walk
+ * must give up there instead of reading MMIO.
+ */
+static const uint32_t spin_code[] = {
+    0x10000437,     /* lui  s0, 0x10000 */
+    0x01040413,     /* addi s0, s0, 16 */
+    0x0000006f,     /* j    . */
+};
+
+/* "hartN;frame;...;leaf count", with at least one frame */
+static void check_folded(const char *path)
+{
+    g_autofree char *contents = NULL;
+    char **lines;
+    int i, n = 0;
+
+    g_assert(g_file_get_contents(path, &contents, NULL, NULL));
+    lines = g_strsplit(contents, "\n", -1);
+
+    for (i = 0; lines[i]; i++) {
+        if (!*lines[i]) {
+            continue;
+        }
+        g_assert(g_regex_match_simple("^hart[0-9]+(;[^; ]+)+ [1-9][0-9]*$",
+                                      lines[i], 0, 0));
+        n++;
+    }
+    g_assert_cmpint(n, >, 0);
+    g_strfreev(lines);
+}
+
+static void test_pc_profile(void)
+{
+    char outtmp[] = "/tmp/qtest-pc-profile-XXXXXX";
+    QTestState *qts;
+    int fd, i;
+
+    fd = mkstemp(outtmp);
+    g_assert(fd != -1);
+    close(fd);
+
+    qts = qtest_init("-M virt -bios none -S -accel tcg");
+    for (i = 0; i < ARRAY_SIZE(spin_code); i++) {
+        qtest_writel(qts, DRAM_BASE + 4 * i, spin_code[i]);
+    }
+
+    qtest_qmp_assert_success(qts, "{ 'execute': 'x-pc-profile-start',"
+                                  "  'arguments': { 'period': 1000,"
+                                  "                 'frames': 4 } }");
+    qtest_qmp_assert_success(qts, "{ 'execute': 'cont' }");
+    g_usleep(200 * 1000);
+    qtest_qmp_assert_success(qts, "{ 'execute': 'x-pc-profile-stop',"
+                                  "  'arguments': { 'filename': %s } }",
+                             outtmp);
+    qtest_quit(qts);
+
+    check_folded(outtmp);
+    unlink(outtmp);
+}
+
+int main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    if (qtest_has_accel("tcg") && qtest_has_machine("virt")) {
+        qtest_add_func("pc-profile/folded", test_pc_profile);
+    }
+
+    return g_test_run();
+}
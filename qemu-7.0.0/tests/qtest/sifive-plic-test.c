@@ -0,0 +1,227 @@
+/*
+ * QTest testcase for the SiFive PLIC, using the tc-newman board
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qlist.h"
+
+#define PLIC_BASE               0x0c000000
+#define PLIC_PRIORITY(irq)      (PLIC_BASE + 4 * (irq))
+#define PLIC_PENDING(irq)       (PLIC_BASE + 0x1000 + 4 * ((irq) / 32))
+#define PLIC_ENABLE(ctx, irq)   (PLIC_BASE + 0x2000 + 0x80 * (ctx) + \
+                                 4 * ((irq) / 32))
+#define PLIC_THRESHOLD(ctx)     (PLIC_BASE + 0x200000 + 0x1000 * (ctx))
+#define PLIC_CLAIM(ctx)         (PLIC_THRESHOLD(ctx) + 4)
+
+#define PLIC_NUM_SOURCES        127
+#define NUM_HARTS               8
+
+/* Every hart has an M and an S mode context, in that order */
+#define CTX_M(hart)             (2 * (hart))
+#define CTX_S(hart)             (2 * (hart) + 1)
+
+/* The PLIC is created without a parent, look it up by type */
+static char *find_plic(QTestState *qts)
+{
+    QDict *resp;
+    QListEntry *e;
+    char *path = NULL;
+
+    resp = qtest_qmp(qts, "{ 'execute': 'qom-list',"
+                          "  'arguments': { 'path': '/machine/unattached' } }");
+    g_assert(qdict_haskey(resp, "return"));
+
+    QLIST_FOREACH_ENTRY(qdict_get_qlist(resp, "return"), e) {
+        QDict *prop = qobject_to(QDict, qlist_entry_obj(e));
+
+        if (!strcmp(qdict_get_str(prop, "type"), "child<riscv.sifive.plic>")) {
+            path = g_strdup_printf("/machine/unattached/%s",
+                                   qdict_get_str(prop, "name"));
+            break;
+        }
+    }
+    qobject_unref(resp);
+
+    g_assert(path);
+    return path;
+}
+
+static void enable_irq(QTestState *qts, int ctx, int irq)
+{
+    uint32_t val = qtest_readl(qts, PLIC_ENABLE(ctx, irq));
+
+    qtest_writel(qts, PLIC_ENABLE(ctx, irq), val | (1u << (irq % 32)));
+}
+
+/*
+ * Sources are level triggered: lowering the line before the claim would
+ * clear the pending bit, so callers lower it once the source is handled.
+ */
+static void raise_irq(QTestState *qts, const char *plic, int irq)
+{
+    qtest_set_irq_in(qts, plic, NULL, irq, 1);
+}
+
+static void lower_irq(QTestState *qts, const char *plic, int irq)
+{
+    qtest_set_irq_in(qts, plic, NULL, irq, 0);
+}
+
+static uint32_t claim(QTestState *qts, int ctx)
+{
+    return qtest_readl(qts, PLIC_CLAIM(ctx));
+}
+
+static void complete(QTestState *qts, int ctx, uint32_t irq)
+{
+    qtest_writel(qts, PLIC_CLAIM(ctx), irq);
+}
+
+static void test_priority(void)
+{
+    QTestState *qts = qtest_init("-machine tc-newman -smp 8");
+    char *plic = find_plic(qts);
+
+    qtest_writel(qts, PLIC_PRIORITY(5), 1);
+    qtest_writel(qts, PLIC_PRIORITY(7), 0);
+    qtest_writel(qts, PLIC_PRIORITY(33), 3);
+    qtest_writel(qts, PLIC_PRIORITY(40), 3);
+    enable_irq(qts, CTX_M(0), 5);
+    enable_irq(qts, CTX_M(0), 7);
+    enable_irq(qts, CTX_M(0), 33);
+    enable_irq(qts, CTX_M(0), 40);
+
+    raise_irq(qts, plic, 5);
+    raise_irq(qts, plic, 7);
+    raise_irq(qts, plic, 40);
+    raise_irq(qts, plic, 33);
+
+    /* Highest priority first, ties are broken by the lower source ID */
+    g_assert_cmpuint(claim(qts, CTX_M(0)), ==, 33);
+    complete(qts, CTX_M(0), 33);
+    lower_irq(qts, plic, 33);
+
+    /* Only sources above the threshold can be claimed */
+    qtest_writel(qts, PLIC_THRESHOLD(CTX_M(0)), 2);
+    g_assert_cmpuint(claim(qts, CTX_M(0)), ==, 40);
+    g_assert_cmpuint(claim(qts, CTX_M(0)), ==, 0);
+    complete(qts, CTX_M(0), 40);
+    lower_irq(qts, plic, 40);
+
+    qtest_writel(qts, PLIC_THRESHOLD(CTX_M(0)), 0);
+    g_assert_cmpuint(claim(qts, CTX_M(0)), ==, 5);
+    complete(qts, CTX_M(0), 5);
+    lower_irq(qts, plic, 5);
+
+    /* Priority 0 never interrupts, but the source stays pending */
+    g_assert_cmpuint(claim(qts, CTX_M(0)), ==, 0);
+    g_assert_cmphex(qtest_readl(qts, PLIC_PENDING(7)), ==, 1u << 7);
+    qtest_writel(qts, PLIC_PRIORITY(7), 2);
+    g_assert_cmpuint(claim(qts, CTX_M(0)), ==, 7);
+    complete(qts, CTX_M(0), 7);
+    lower_irq(qts, plic, 7);
+
+    g_free(plic);
+    qtest_quit(qts);
+}
+
+static void test_enable(void)
+{
+    QTestState *qts = qtest_init("-machine tc-newman -smp 8");
+    char *plic = find_plic(qts);
+
+    qtest_writel(qts, PLIC_PRIORITY(70), 4);
+    raise_irq(qts, plic, 70);
+
+    /* Enabling a source that is already pending makes it claimable */
+    g_assert_cmpuint(claim(qts, CTX_S(3)), ==, 0);
+    enable_irq(qts, CTX_S(3), 70);
+    g_assert_cmpuint(claim(qts, CTX_S(3)), ==, 70);
+    lower_irq(qts, plic, 70);
+
+    /* A claimed source is not offered again until it is completed */
+    raise_irq(qts, plic, 70);
+    g_assert_cmpuint(claim(qts, CTX_S(3)), ==, 0);
+    complete(qts, CTX_S(3), 70);
+    g_assert_cmpuint(claim(qts, CTX_S(3)), ==, 70);
+    complete(qts, CTX_S(3), 70);
+    lower_irq(qts, plic, 70);
+
+    g_free(plic);
+    qtest_quit(qts);
+}
+
+/*
+ * Interrupt storm: raise every source at once and let the M mode contexts
+ * of all harts claim and complete them, like a guest with one handler per
+ * hart would.  Reports the number of interrupts handled per second.
+ */
+static void test_storm(void)
+{
+    QTestState *qts = qtest_init("-machine tc-newman -smp 8");
+    char *plic = find_plic(qts);
+    int rounds = g_test_slow() ? 2000 : 20;
+    int64_t start, elapsed;
+    uint64_t handled = 0;
+    int hart, irq, r;
+
+    for (irq = 1; irq < PLIC_NUM_SOURCES; irq++) {
+        qtest_writel(qts, PLIC_PRIORITY(irq), irq % 7 + 1);
+    }
+    for (hart = 0; hart < NUM_HARTS; hart++) {
+        for (irq = 0; irq < PLIC_NUM_SOURCES; irq += 32) {
+            qtest_writel(qts, PLIC_ENABLE(CTX_M(hart), irq), -1);
+        }
+    }
+
+    start = g_get_monotonic_time();
+    for (r = 0; r < rounds; r++) {
+        uint32_t prio = 8;
+        bool busy = true;
+
+        for (irq = 1; irq < PLIC_NUM_SOURCES; irq++) {
+            raise_irq(qts, plic, irq);
+        }
+
+        while (busy) {
+            busy = false;
+            for (hart = 0; hart < NUM_HARTS; hart++) {
+                uint32_t got = claim(qts, CTX_M(hart));
+
+                if (got) {
+                    /* Claims come out in priority order */
+                    g_assert_cmpuint(got % 7 + 1, <=, prio);
+                    prio = got % 7 + 1;
+                    complete(qts, CTX_M(hart), got);
+                    lower_irq(qts, plic, got);
+                    handled++;
+                    busy = true;
+                }
+            }
+        }
+    }
+    elapsed = g_get_monotonic_time() - start;
+
+    g_assert_cmpuint(handled, ==, (uint64_t)rounds * (PLIC_NUM_SOURCES - 1));
+    g_test_message("%" PRIu64 " interrupts in %" PRId64 " us, %.0f/s",
+                   handled, elapsed, handled * 1e6 / MAX(elapsed, 1));
+
+    g_free(plic);
+    qtest_quit(qts);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/sifive-plic/priority", test_priority);
+    qtest_add_func("/sifive-plic/enable", test_enable);
+    qtest_add_func("/sifive-plic/storm", test_storm);
+
+    return g_test_run();
+}
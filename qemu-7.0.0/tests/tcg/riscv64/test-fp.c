@@ -0,0 +1,76 @@
+/*
+ * Check and time double-precision arithmetic with frequent fflags clears.
+ *
+ * The accrued exception flags must be exact even though the emulator
+ * only tracks the inexact flag lazily; the timed loop is a daxpy kernel
+ * that clears fflags every iteration, as code using feclearexcept() or
+ * fetestexcept() around each step does.
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <time.h>
+
+#define N           1024
+#define ITERATIONS  (4 * 1000)
+
+#define FFLAGS_NX   0x01
+
+static double x[N], y[N];
+
+static unsigned long read_fflags(void)
+{
+    unsigned long val;
+
+    asm volatile("frflags %0" : "=r" (val));
+    return val;
+}
+
+static void clear_fflags(void)
+{
+    asm volatile("fsflags zero");
+}
+
+static double fdiv(double a, double b)
+{
+    double r;
+
+    asm volatile("fdiv.d %0, %1, %2" : "=f" (r) : "f" (a), "f" (b));
+    return r;
+}
+
+int main(void)
+{
+    struct timespec start, end;
+    double a = 1.0 / 3.0, ns;
+    long i, j;
+
+    /* Exact results must not raise NX, inexact ones must. */
+    clear_fflags();
+    assert(fdiv(1.0, 4.0) == 0.25);
+    assert(read_fflags() == 0);
+    fdiv(1.0, 3.0);
+    assert(read_fflags() == FFLAGS_NX);
+    clear_fflags();
+    assert(fdiv(3.0, 2.0) == 1.5);
+    assert(read_fflags() == 0);
+
+    for (i = 0; i < N; i++) {
+        x[i] = i;
+        y[i] = N - i;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (j = 0; j < ITERATIONS; j++) {
+        clear_fflags();
+        for (i = 0; i < N; i++) {
+            y[i] += a * x[i];
+        }
+        assert(read_fflags() == FFLAGS_NX);
+        a = -a;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    printf("daxpy loop: %.2f ns/element\n", ns / ((double)ITERATIONS * N));
+    return 0;
+}
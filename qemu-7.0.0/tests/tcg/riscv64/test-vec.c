@@ -0,0 +1,120 @@
+/*
+ * Check and time RVV integer ops that are expanded with host vectors.
+ *
+ * Each instruction family is checked on a full LMUL=8 register group
+ * with vl == VLMAX, the only case expanded inline, including the vxsat
+ * flag of the saturating ops, and then timed in a register-only loop.
+ */
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/* e32, m8 with the largest VLEN QEMU supports */
+#define MAX_ELEMS   (8 * 1024 / 32)
+#define ITERATIONS  (100 * 1000)
+
+static uint32_t a[MAX_ELEMS], b[MAX_ELEMS], r[MAX_ELEMS];
+static unsigned long vl;
+
+#define VV(INSN)    INSN " v24, v8, v16\n\t"
+#define VX(INSN)    INSN " v24, v8, %[x]\n\t"
+
+/* v24 = a OP b, returns vxsat */
+#define RUN(ASM, X)                                                     \
+({                                                                      \
+    unsigned long sat;                                                  \
+    asm volatile("csrw vxsat, zero\n\t"                                 \
+                 "vsetvli %[vl], zero, e32, m8, ta, ma\n\t"             \
+                 "vle32.v v8, (%[a])\n\t"                               \
+                 "vle32.v v16, (%[b])\n\t"                              \
+                 ASM                                                    \
+                 "vse32.v v24, (%[r])\n\t"                              \
+                 "csrr %[sat], vxsat"                                   \
+                 : [vl] "=&r" (vl), [sat] "=&r" (sat)                   \
+                 : [a] "r" (a), [b] "r" (b), [r] "r" (r),               \
+                   [x] "r" ((unsigned long)(X))                         \
+                 : "memory");                                           \
+    sat;                                                                \
+})
+
+#define TIME(NAME, ASM, X)                                              \
+do {                                                                    \
+    struct timespec start, end;                                         \
+    unsigned long n = ITERATIONS;                                       \
+    double ns;                                                          \
+                                                                        \
+    clock_gettime(CLOCK_MONOTONIC, &start);                             \
+    asm volatile("vsetvli t0, zero, e32, m8, ta, ma\n\t"                \
+                 "vle32.v v8, (%[a])\n\t"                               \
+                 "vle32.v v16, (%[b])\n\t"                              \
+                 "1:\n\t"                                               \
+                 ASM ASM ASM ASM ASM ASM ASM ASM                        \
+                 "addi %[n], %[n], -1\n\t"                              \
+                 "bnez %[n], 1b"                                        \
+                 : [n] "+r" (n)                                         \
+                 : [a] "r" (a), [b] "r" (b),                            \
+                   [x] "r" ((unsigned long)(X))                         \
+                 : "t0", "memory");                                     \
+    clock_gettime(CLOCK_MONOTONIC, &end);                               \
+                                                                        \
+    ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec); \
+    printf("%-12s %8.2f ns/insn, %6.3f ns/element\n", NAME,             \
+           ns / (ITERATIONS * 8), ns / (ITERATIONS * 8 * vl));         \
+} while (0)
+
+static void fill(uint32_t x, uint32_t y)
+{
+    int i;
+
+    for (i = 0; i < MAX_ELEMS; i++) {
+        a[i] = x + i;
+        b[i] = y - i;
+    }
+}
+
+int main(void)
+{
+    unsigned long i;
+
+    fill(1000, 2000);
+    assert(RUN(VV("vadd.vv"), 0) == 0);
+    for (i = 0; i < vl; i++) {
+        assert(r[i] == 3000);
+    }
+    RUN(VV("vmul.vv"), 0);
+    for (i = 0; i < vl; i++) {
+        assert(r[i] == (uint32_t)((1000 + i) * (2000 - i)));
+    }
+
+    /* Min/max against a scalar */
+    RUN(VX("vminu.vx"), 1010);
+    for (i = 0; i < vl; i++) {
+        assert(r[i] == (i < 10 ? 1000 + i : 1010));
+    }
+    RUN(VX("vmax.vx"), -1);
+    for (i = 0; i < vl; i++) {
+        assert(r[i] == 1000 + i);
+    }
+
+    /* Saturating ops must set vxsat only when an element saturates */
+    assert(RUN(VV("vsaddu.vv"), 0) == 0);
+    fill(UINT32_MAX - 4, 8);
+    assert(RUN(VV("vsaddu.vv"), 0) == 1);
+    assert(r[0] == UINT32_MAX && r[5] == 3);
+    fill(INT32_MIN + 2, 4);
+    assert(RUN(VV("vssub.vv"), 0) == 1);
+    assert(r[0] == INT32_MIN && r[2] == INT32_MIN + 2);
+    assert(RUN(VV("vssubu.vv"), 0) == 1);
+    assert(r[0] == (uint32_t)INT32_MIN - 2 && r[vl - 1] == 0);
+
+    fill(1000, 2000);
+    TIME("vadd.vv", VV("vadd.vv"), 0);
+    TIME("vmul.vv", VV("vmul.vv"), 0);
+    TIME("vmul.vx", VX("vmul.vx"), 3);
+    TIME("vminu.vx", VX("vminu.vx"), 1010);
+    TIME("vmax.vv", VV("vmax.vv"), 0);
+    TIME("vsaddu.vv", VV("vsaddu.vv"), 0);
+    TIME("vssub.vv", VV("vssub.vv"), 0);
+    return 0;
+}
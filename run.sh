@@ -1,7 +1,9 @@
 SHELL_FOLDER=$(cd "$(dirname "$0")";pwd)
+#第一个参数可以指定pflash固件,默认为fw.bin
+FW=${1:-fw.bin}
 $SHELL_FOLDER/output/qemu/bin/qemu-system-riscv64 \
 -M tc-newman \
 -m 1G \
 -smp 8 \
--drive if=pflash,bus=0,unit=0,format=raw,file=$SHELL_FOLDER/output/lowlevelboot/fw.bin \
+-drive if=pflash,bus=0,unit=0,format=raw,file=$SHELL_FOLDER/output/lowlevelboot/$FW \
 -nographic --parallel none